@@ -0,0 +1,146 @@
+// ALR lookup benchmark: the flat packed-key AlrStore against the
+// std::unordered_map<std::string, AlrRecord> it replaced, at several sizes.
+//
+//   alr_bench [subscribers ...]
+//
+// Sizes default to 1000000 10000000 100000000. For each one both stores are
+// filled with synthetic North-American subscribers (200 MSCs, 2000 VLRs,
+// 8 regions) and probed with random hits; the figures are heap bytes per
+// subscriber (malloc statistics, so allocator overhead is included) and
+// ns per lookup, key formatting included. A store that would not fit in
+// the available memory is skipped.
+#include "alr_store.hpp"
+
+#include <malloc.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+using namespace tr;
+
+namespace {
+
+constexpr size_t LOOKUPS = 5000000;
+constexpr double MAP_BYTES_ESTIMATE = 220.0; // per subscriber, for the memory check
+
+using MapStore = std::unordered_map<std::string, AlrRecord>;
+
+size_t heap_bytes() {
+  const auto mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+size_t mem_available() {
+  std::ifstream f("/proc/meminfo");
+  std::string line;
+  while (std::getline(f, line)) {
+    if (line.rfind("MemAvailable:", 0) == 0) return std::strtoull(line.c_str() + 13, nullptr, 10) * 1024;
+  }
+  return 0;
+}
+
+// "+1" and ten digits, distinct for every i below 10^9.
+size_t format_msisdn(size_t i, char* out) {
+  size_t v = 2000000000 + i * 7;
+  out[0] = '+';
+  out[1] = '1';
+  for (size_t d = 11; d >= 2; --d, v /= 10) out[d] = static_cast<char>('0' + v % 10);
+  return 12;
+}
+
+AlrRecord make_record(size_t i) {
+  char buf[32];
+  AlrRecord r;
+  std::snprintf(buf, sizeof(buf), "31015%010zu", i);
+  r.imsi = buf;
+  std::snprintf(buf, sizeof(buf), "MSC_%03zu", i % 200);
+  r.serving_msc = buf;
+  std::snprintf(buf, sizeof(buf), "VLR_%04zu", i % 2000);
+  r.serving_vlr = buf;
+  std::snprintf(buf, sizeof(buf), "REGION_%zu", i % 8);
+  r.region = buf;
+  return r;
+}
+
+uint64_t next_rand(uint64_t& s) {
+  s ^= s << 13;
+  s ^= s >> 7;
+  s ^= s << 17;
+  return s;
+}
+
+// Time LOOKUPS random hits; returns ns per lookup. `probe` must return
+// something derived from the record so the lookup cannot be elided.
+template <typename Probe>
+double time_lookups(size_t n, Probe&& probe) {
+  uint64_t seed = 0x9e3779b97f4a7c15ull, sink = 0;
+  char key[16];
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t k = 0; k < LOOKUPS; ++k) {
+    const size_t len = format_msisdn(next_rand(seed) % n, key);
+    sink += probe(std::string_view(key, len));
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  if (sink == 0) std::printf("(no hits)\n");
+  return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) /
+         static_cast<double>(LOOKUPS);
+}
+
+void bench_map(size_t n) {
+  if (MAP_BYTES_ESTIMATE * static_cast<double>(n) > 0.8 * static_cast<double>(mem_available())) {
+    std::printf("%12zu  unordered_map  skipped (needs ~%.1f GB)\n", n, MAP_BYTES_ESTIMATE * static_cast<double>(n) / 1e9);
+    return;
+  }
+  const size_t before = heap_bytes();
+  MapStore db;
+  db.reserve(n);
+  char key[16];
+  for (size_t i = 0; i < n; ++i) db.emplace(std::string(key, format_msisdn(i, key)), make_record(i));
+  const double per_sub = static_cast<double>(heap_bytes() - before) / static_cast<double>(n);
+  const double ns = time_lookups(n, [&](std::string_view k) {
+    auto it = db.find(std::string(k));
+    return it == db.end() ? 0 : it->second.imsi.size();
+  });
+  std::printf("%12zu  unordered_map  %8.1f B/sub  %7.1f ns/lookup\n", n, per_sub, ns);
+}
+
+void bench_flat(size_t n) {
+  size_t cap = 16;
+  while (cap * 3 / 4 < n) cap <<= 1;
+  if (static_cast<double>(cap * sizeof(AlrEntry)) > 0.8 * static_cast<double>(mem_available())) {
+    std::printf("%12zu  AlrStore       skipped (needs ~%.1f GB)\n", n, static_cast<double>(cap * sizeof(AlrEntry)) / 1e9);
+    return;
+  }
+  const size_t before = heap_bytes();
+  AlrStore alr;
+  alr.reserve(n);
+  char key[16];
+  for (size_t i = 0; i < n; ++i) alr.insert(std::string_view(key, format_msisdn(i, key)), make_record(i));
+  const double per_sub = static_cast<double>(heap_bytes() - before) / static_cast<double>(n);
+  const double ns = time_lookups(n, [&](std::string_view k) {
+    const auto v = alr.find(k);
+    return v ? v->imsi : 0;
+  });
+  std::printf("%12zu  AlrStore       %8.1f B/sub  %7.1f ns/lookup\n", n, per_sub, ns);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::vector<size_t> sizes;
+  for (int i = 1; i < argc; ++i) sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+  if (sizes.empty()) sizes = {1000000, 10000000, 100000000};
+
+  for (size_t n : sizes) {
+    if (n == 0 || n > 1000000000) {
+      std::fprintf(stderr, "subscribers must be 1..1000000000\n");
+      return 2;
+    }
+    bench_map(n);
+    malloc_trim(0); // hand the freed map nodes back before sizing the next run
+    bench_flat(n);
+    malloc_trim(0);
+  }
+  return 0;
+}
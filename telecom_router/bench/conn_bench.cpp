@@ -0,0 +1,149 @@
+// Idle-connection footprint benchmark: open many loopback connections to a
+// running routing_server and report how much its RSS grew per connection.
+//
+//   conn_bench <server_pid> [connections] [port] [ping]
+//
+// connections defaults to 1000000. With ping=1 every connection first sends
+// one route request and waits for its answer (OK, TIMEOUT or BUSY), so each
+// one has attached and returned I/O buffers before it goes idle.
+//
+// Both processes need an fd limit above the connection count (ulimit -n,
+// fs.nr_open). Source addresses rotate over 127.0.0.1, 127.0.0.2, ... so the
+// ephemeral port range is not the limit; the kernel-side socket memory is
+// not part of the figure.
+#include "common.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+using namespace tr;
+
+namespace {
+
+constexpr size_t CONNS_PER_SRC_ADDR = 20000; // stays inside the default ephemeral range
+constexpr int RESPONSE_WAIT_MS = 30000;
+
+// VmRSS of pid in KiB, 0 if unreadable.
+size_t rss_kib(long pid) {
+  std::ifstream f("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(f, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) return std::strtoull(line.c_str() + 6, nullptr, 10);
+  }
+  return 0;
+}
+
+size_t raise_fd_limit() {
+  rlimit nofile{};
+  if (getrlimit(RLIMIT_NOFILE, &nofile) != 0) return 0;
+  nofile.rlim_cur = nofile.rlim_max;
+  (void)setrlimit(RLIMIT_NOFILE, &nofile);
+  return nofile.rlim_cur;
+}
+
+int connect_one(size_t i, uint16_t port) {
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  const auto src_host = static_cast<uint32_t>(1 + i / CONNS_PER_SRC_ADDR);
+  sockaddr_in src{};
+  src.sin_family = AF_INET;
+  src.sin_addr.s_addr = htonl((127u << 24) | src_host);
+  sockaddr_in dst{};
+  dst.sin_family = AF_INET;
+  dst.sin_port = htons(port);
+  dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&src), sizeof(src)) != 0 ||
+      ::connect(fd, reinterpret_cast<sockaddr*>(&dst), sizeof(dst)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Send one request on every connection and wait for a line back on each.
+size_t ping_all(const std::vector<int>& fds) {
+  static const char req[] = "{\"msisdn\":\"+14085551234\",\"op\":\"route\"}\n";
+  const int ep = epoll_create1(0);
+  if (ep < 0) return 0;
+  for (size_t i = 0; i < fds.size(); ++i) {
+    if (::send(fds[i], req, sizeof(req) - 1, MSG_NOSIGNAL) < 0) continue;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    (void)epoll_ctl(ep, EPOLL_CTL_ADD, fds[i], &ev);
+  }
+  size_t answered = 0;
+  const uint64_t deadline = steady_millis() + RESPONSE_WAIT_MS;
+  epoll_event events[256];
+  char buf[4096];
+  while (answered < fds.size() && steady_millis() < deadline) {
+    const int n = epoll_wait(ep, events, 256, 100);
+    for (int k = 0; k < n; ++k) {
+      const int fd = fds[events[k].data.u64];
+      if (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) ++answered;
+      (void)epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+    }
+  }
+  ::close(ep);
+  return answered;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: conn_bench <server_pid> [connections] [port] [ping]\n");
+    return 2;
+  }
+  const long pid = std::strtol(argv[1], nullptr, 10);
+  size_t conns = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+  const auto port = static_cast<uint16_t>(argc > 3 ? std::atoi(argv[3]) : 5555);
+  const bool ping = argc > 4 && std::atoi(argv[4]) != 0;
+
+  const size_t limit = raise_fd_limit();
+  if (limit < conns + 16) {
+    std::fprintf(stderr, "fd limit %zu: capping at %zu connections\n", limit, limit - 16);
+    conns = limit - 16;
+  }
+
+  const size_t rss0 = rss_kib(pid);
+  if (rss0 == 0) {
+    std::fprintf(stderr, "cannot read /proc/%ld/status\n", pid);
+    return 1;
+  }
+
+  std::vector<int> fds;
+  fds.reserve(conns);
+  for (size_t i = 0; i < conns; ++i) {
+    const int fd = connect_one(i, port);
+    if (fd < 0) {
+      std::fprintf(stderr, "connect %zu failed: %s\n", i, std::strerror(errno));
+      break;
+    }
+    fds.push_back(fd);
+    if ((i + 1) % 100000 == 0) std::fprintf(stderr, "%zu connected\n", i + 1);
+  }
+
+  size_t answered = 0;
+  if (ping) answered = ping_all(fds);
+  // Let the server accept whatever is still in its backlog.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  const size_t rss1 = rss_kib(pid);
+  const double grew = (static_cast<double>(rss1) - static_cast<double>(rss0)) * 1024.0;
+  const double per_conn = fds.empty() ? 0.0 : grew / static_cast<double>(fds.size());
+  std::printf("connections=%zu%s rss_before=%zu KiB rss_after=%zu KiB rss_per_conn=%.1f B\n",
+              fds.size(), ping ? (" answered=" + std::to_string(answered)).c_str() : "",
+              rss0, rss1, per_conn);
+
+  for (int fd : fds) ::close(fd);
+  return 0;
+}
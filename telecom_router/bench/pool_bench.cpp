@@ -0,0 +1,132 @@
+// Contention benchmark: work-stealing ThreadPool vs the previous single
+// mutex + condition_variable queue.
+//
+//   pool_bench [tasks_per_producer] [workers]
+//
+// Scenarios:
+//   inject/P  - P external threads (like reactors) submit tiny tasks
+//   fanout    - tasks submitted from inside workers (local deque path)
+#include "thread_pool.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <queue>
+
+using namespace tr;
+
+namespace {
+
+// The pool as it was before work stealing: one queue, one lock.
+class LockedPool {
+public:
+  explicit LockedPool(size_t n) {
+    for (size_t i = 0; i < n; ++i) workers_.emplace_back([this] { loop(); });
+  }
+  ~LockedPool() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+  }
+  void submit(std::function<void()> fn) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      q_.push(std::move(fn));
+    }
+    cv_.notify_one();
+  }
+
+private:
+  void loop() {
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&] { return stop_ || !q_.empty(); });
+        if (stop_ && q_.empty()) return;
+        job = std::move(q_.front());
+        q_.pop();
+      }
+      job();
+    }
+  }
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::queue<std::function<void()>> q_;
+  std::vector<std::thread> workers_;
+  bool stop_{false};
+};
+
+struct Latch {
+  std::atomic<uint64_t> left;
+  explicit Latch(uint64_t n) : left(n) {}
+  void count_down() { left.fetch_sub(1, std::memory_order_acq_rel); }
+  void wait() const {
+    while (left.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+  }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template <class Pool>
+double bench_inject(size_t workers, size_t producers, uint64_t per_producer) {
+  Pool pool(workers);
+  Latch done(producers * per_producer);
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> prod;
+  for (size_t p = 0; p < producers; ++p) {
+    prod.emplace_back([&] {
+      for (uint64_t i = 0; i < per_producer; ++i) pool.submit([&done] { done.count_down(); });
+    });
+  }
+  for (auto& t : prod) t.join();
+  done.wait();
+  return static_cast<double>(producers * per_producer) / seconds_since(t0);
+}
+
+template <class Pool>
+void spawn(Pool& pool, Latch& done, unsigned depth) {
+  if (depth == 0) { done.count_down(); return; }
+  pool.submit([&pool, &done, depth] { spawn(pool, done, depth - 1); });
+  pool.submit([&pool, &done, depth] { spawn(pool, done, depth - 1); });
+}
+
+template <class Pool>
+double bench_fanout(size_t workers, unsigned depth) {
+  Pool pool(workers);
+  const uint64_t leaves = uint64_t{1} << depth;
+  Latch done(leaves);
+  const auto t0 = std::chrono::steady_clock::now();
+  spawn(pool, done, depth);
+  done.wait();
+  return static_cast<double>(2 * leaves - 2) / seconds_since(t0);
+}
+
+void row(const char* name, double locked, double stealing) {
+  std::printf("%-12s %14.2f %14.2f %8.2fx\n", name, locked / 1e6, stealing / 1e6, stealing / locked);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const uint64_t per = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  const size_t workers = argc > 2 ? std::strtoull(argv[2], nullptr, 10)
+                                  : std::max<size_t>(2, std::thread::hardware_concurrency());
+
+  std::printf("workers=%zu tasks/producer=%llu\n", workers, static_cast<unsigned long long>(per));
+  std::printf("%-12s %14s %14s %9s\n", "scenario", "locked Mops/s", "steal Mops/s", "speedup");
+  for (size_t p : {1, 2, 4, 8}) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "inject/%zu", p);
+    row(name, bench_inject<LockedPool>(workers, p, per), bench_inject<ThreadPool>(workers, p, per));
+  }
+  row("fanout", bench_fanout<LockedPool>(workers, 18), bench_fanout<ThreadPool>(workers, 18));
+  return 0;
+}
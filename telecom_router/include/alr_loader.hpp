@@ -0,0 +1,176 @@
+#pragma once
+#include "alr_table.hpp"
+#include "intern_pool.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace tr {
+
+struct AlrLoadStats {
+  size_t rows{0};     // data rows seen (header excluded)
+  size_t rejected{0}; // bad MSISDN / IMSI, or a missing or empty name
+  size_t loaded{0};   // distinct subscribers in the result
+};
+
+namespace alr_load_detail {
+
+// Cut [b, e) at field separator sep: returns the field, advances b past it.
+inline std::string_view next_field(const char*& b, const char* e, char sep) {
+  const char* p = static_cast<const char*>(std::memchr(b, sep, static_cast<size_t>(e - b)));
+  const char* f = p ? p : e;
+  std::string_view out(b, static_cast<size_t>(f - b));
+  b = p ? p + 1 : e;
+  return out;
+}
+
+// One parsing thread's view of a name pool: the global pool is locked only
+// the first time the thread meets a name. Keys view into the mapping.
+struct NameCache {
+  explicit NameCache(InternPool& p) : pool(p) {}
+
+  uint16_t operator()(std::string_view s) {
+    auto it = ids.find(s);
+    if (it != ids.end()) return it->second;
+    const uint16_t id = pool.intern(s);
+    ids.emplace(s, id);
+    return id;
+  }
+
+  InternPool& pool;
+  std::unordered_map<std::string_view, uint16_t> ids;
+};
+
+} // namespace alr_load_detail
+
+// Load a provisioning dump into a new table using `threads` threads.
+// One row per line: msisdn, imsi, msc, vlr, region, separated by tabs if
+// the first line has one, else by commas; CRLF is accepted, a first line
+// not starting with a digit or '+' is taken as a header, extra columns are
+// ignored and bad rows are counted and skipped. The file is mapped and cut into per-thread chunks
+// on line boundaries; each thread parses its chunk into entries bucketed
+// by table region, then the regions are filled in parallel (AlrTable::build),
+// later rows replacing earlier ones for the same MSISDN. Throws on I/O errors
+// and if a name pool overflows (more than 65536 distinct MSCs, VLRs or
+// regions), after every thread has stopped.
+inline AlrTable load_alr_dump(const std::string& path, size_t threads, AlrLoadStats& stats) {
+  using namespace alr_load_detail;
+  stats = AlrLoadStats{};
+  threads = std::max<size_t>(threads, 1);
+
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::runtime_error("ALR dump open failed for " + path + ": " + std::strerror(errno));
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("ALR dump stat failed for " + path);
+  }
+  const auto size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    ::close(fd);
+    return AlrTable();
+  }
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) throw std::runtime_error("ALR dump mmap failed for " + path);
+  (void)madvise(map, size, MADV_SEQUENTIAL);
+  const char* const base = static_cast<const char*>(map);
+  const char* const end = base + size;
+
+  // separator and header from the first line
+  const char* first_nl = static_cast<const char*>(std::memchr(base, '\n', size));
+  const char* line1_end = first_nl ? first_nl : end;
+  const char sep = std::memchr(base, '\t', static_cast<size_t>(line1_end - base)) ? '\t' : ',';
+  const char* data = base;
+  if (!(*base == '+' || (*base >= '0' && *base <= '9'))) data = first_nl ? first_nl + 1 : end;
+
+  // chunk i is [cuts[i], cuts[i+1]), each ending just after a newline
+  std::vector<const char*> cuts{data};
+  const auto span = static_cast<size_t>(end - data);
+  for (size_t i = 1; i < threads; ++i) {
+    const char* p = std::max(data + span * i / threads, cuts.back());
+    const char* nl = p < end ? static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p))) : nullptr;
+    cuts.push_back(nl ? nl + 1 : end);
+  }
+  cuts.push_back(end);
+
+  auto run = [&](auto&& fn) {
+    try {
+      run_on_threads(threads, fn);
+    } catch (...) {
+      munmap(map, size);
+      throw;
+    }
+  };
+
+  // Pass 1: count lines, which bounds the table size and so fixes its layout.
+  std::vector<size_t> lines(threads, 0);
+  run([&](size_t t) {
+    for (const char* p = cuts[t]; p < cuts[t + 1]; ++lines[t]) {
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(cuts[t + 1] - p)));
+      p = nl ? nl + 1 : cuts[t + 1];
+    }
+  });
+  size_t total = 0;
+  for (size_t n : lines) total += n;
+  const size_t cap = AlrTable::capacity_for(total);
+  size_t regions = 1;
+  while (regions < threads * 8 && regions * 2 <= cap / 16) regions <<= 1;
+
+  // Pass 2: parse each chunk into per-region buckets, in input order.
+  std::vector<std::vector<std::vector<AlrEntry>>> buckets(threads, std::vector<std::vector<AlrEntry>>(regions));
+  std::vector<AlrLoadStats> part(threads);
+  run([&](size_t t) {
+    NameCache msc(msc_names()), vlr(vlr_names()), region(region_names());
+    for (auto& b : buckets[t]) b.reserve(lines[t] / regions + lines[t] / regions / 8 + 16);
+    const char* p = cuts[t];
+    const char* const stop = cuts[t + 1];
+    while (p < stop) {
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(stop - p)));
+      const char* le = nl ? nl : stop;
+      const char* next = nl ? nl + 1 : stop;
+      if (le > p && le[-1] == '\r') --le;
+      if (le == p) { // blank line
+        p = next;
+        continue;
+      }
+      ++part[t].rows;
+      const auto f_msisdn = next_field(p, le, sep);
+      const auto f_imsi = next_field(p, le, sep);
+      const auto f_msc = next_field(p, le, sep);
+      const auto f_vlr = next_field(p, le, sep);
+      const auto f_region = next_field(p, le, sep);
+      AlrEntry e;
+      e.msisdn = pack_digits(f_msisdn);
+      e.imsi = pack_digits(f_imsi);
+      if (e.msisdn == 0 || e.imsi == 0 || f_msc.empty() || f_vlr.empty() || f_region.empty()) {
+        ++part[t].rejected;
+      } else {
+        e.location = alr_location(msc(f_msc), vlr(f_vlr), region(f_region));
+        buckets[t][AlrTable::region_of(e.msisdn, cap, regions)].push_back(e);
+      }
+      p = next;
+    }
+  });
+  munmap(map, size);
+
+  // Pass 3: fill the table regions in parallel, chunk by chunk so that the
+  // last row for a key wins; each bucket is freed once consumed.
+  AlrTable table = AlrTable::build(total, regions, threads, [&](size_t r, auto&& put) {
+    for (size_t t = 0; t < threads; ++t) {
+      for (const AlrEntry& e : buckets[t][r]) put(e);
+      std::vector<AlrEntry>().swap(buckets[t][r]);
+    }
+  });
+  for (const auto& s : part) {
+    stats.rows += s.rows;
+    stats.rejected += s.rejected;
+  }
+  stats.loaded = table.size();
+  return table;
+}
+
+} // namespace tr
@@ -0,0 +1,227 @@
+#pragma once
+#include "alr_table.hpp"
+#include "intern_pool.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+
+namespace tr {
+
+// On-disk ALR snapshot, served straight from a private mapping of the file.
+// Only offsets, no pointers, so the file maps anywhere, and every engine on
+// the host that maps it shares one copy in the page cache; a page is copied
+// into the process only when a location update writes to it (the file
+// itself is never modified).
+//
+//   [AlrSnapshotHeader][names][pad to 64][slots: capacity x AlrEntry]
+//
+// The slot array is an AlrTable image (same layout, alr_home hash and
+// linear probing), so a lookup probes the mapping directly. The names
+// section holds, for MSCs, VLRs and regions in turn, a uint32_t count and
+// then count x (uint16_t length, bytes); an entry's ids index those lists.
+// Host byte order; any change to the layout or hash bumps the version.
+struct AlrSnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size; // sizeof(AlrEntry)
+  uint64_t count;      // subscribers
+  uint64_t capacity;   // slots, a power of two
+  uint64_t names_offset;
+  uint64_t names_bytes;
+  uint64_t slots_offset; // 64-byte aligned
+};
+
+class AlrSnapshot {
+public:
+  static constexpr char MAGIC[8] = {'T', 'R', 'A', 'L', 'R', 'S', 'N', 'P'};
+  static constexpr uint32_t VERSION = 1;
+
+  AlrSnapshot() = default;
+  ~AlrSnapshot() { close(); }
+
+  AlrSnapshot(const AlrSnapshot&) = delete;
+  AlrSnapshot& operator=(const AlrSnapshot&) = delete;
+
+  // Map path and check its header. Cost is independent of the subscriber
+  // count: only the names are read, to map their ids onto the global pools.
+  void open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("ALR snapshot open failed for " + path + ": " + std::strerror(errno));
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(AlrSnapshotHeader)) {
+      ::close(fd);
+      throw std::runtime_error("ALR snapshot truncated: " + path);
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("ALR snapshot mmap failed for " + path);
+    base_ = static_cast<uint8_t*>(p);
+    size_ = size;
+    // hash probes touch one random page each: read-ahead would be wasted
+    (void)madvise(p, size, MADV_RANDOM);
+
+    AlrSnapshotHeader h;
+    std::memcpy(&h, base_, sizeof(h));
+    // an empty snapshot has no slots; otherwise a power of two with a free one
+    const bool slots_ok = h.capacity == 0 ? h.count == 0 : (h.capacity & (h.capacity - 1)) == 0 && h.count < h.capacity;
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION ||
+        h.entry_size != sizeof(AlrEntry) || !slots_ok || h.slots_offset % 64 != 0 ||
+        h.names_offset > size || h.names_bytes > size - h.names_offset || h.slots_offset > size ||
+        h.capacity > (size - h.slots_offset) / sizeof(AlrEntry)) {
+      close();
+      throw std::runtime_error("ALR snapshot layout mismatch: " + path);
+    }
+    try {
+      read_names(base_ + h.names_offset, h.names_bytes);
+    } catch (const std::exception&) {
+      close();
+      throw std::runtime_error("ALR snapshot names corrupt: " + path);
+    }
+    slots_ = reinterpret_cast<AlrEntry*>(base_ + h.slots_offset);
+    cap_ = h.capacity;
+    count_ = h.count;
+  }
+
+  void close() {
+    if (base_) munmap(base_, size_);
+    base_ = nullptr;
+    slots_ = nullptr;
+    cap_ = count_ = 0;
+  }
+
+  bool is_open() const { return base_ != nullptr; }
+  size_t size() const { return count_; }
+
+  // Entry for a packed key, its name ids translated to the global pools.
+  std::optional<AlrEntry> find(uint64_t key) const {
+    const AlrEntry* e = alr_probe(slots_, cap_, key);
+    if (!e) return std::nullopt;
+    return global(e->load());
+  }
+
+  // Move the subscriber at key to new global ids (no region: keep it).
+  // Safe against concurrent find() and updates; false if key is absent.
+  // The write lands in this process's copy-on-write copy of the page: it
+  // is not seen by other mappings, does not survive close(), and the page
+  // stops being shared. for_each() (and so a new snapshot) includes it.
+  bool update_location(uint64_t key, uint16_t msc, uint16_t vlr, std::optional<uint16_t> region) {
+    auto* e = const_cast<AlrEntry*>(alr_probe(slots_, cap_, key));
+    if (!e) return false;
+    alr_update_location(*e, [&](uint64_t old) {
+      const uint16_t rg = region ? *region : global(AlrEntry{0, 0, old}).region();
+      return GLOBAL_IDS | alr_location(msc, vlr, rg);
+    });
+    return true;
+  }
+
+  // Call fn(const AlrEntry&) for every subscriber, ids already global.
+  template <typename F>
+  void for_each(F&& fn) const {
+    for (size_t i = 0; i < cap_; ++i) {
+      if (slots_[i].msisdn) fn(global(slots_[i].load()));
+    }
+  }
+
+  // Write table as a snapshot at path. Goes through path.tmp and a rename,
+  // so engines that have the old file mapped keep serving it undisturbed.
+  static void write(const std::string& path, const AlrTable& table) {
+    std::string names;
+    for (InternPool* pool : {&msc_names(), &vlr_names(), &region_names()}) {
+      const auto n = static_cast<uint32_t>(pool->size());
+      append_raw(names, n);
+      for (uint32_t id = 0; id < n; ++id) {
+        const auto name = pool->name(static_cast<uint16_t>(id));
+        append_raw(names, static_cast<uint16_t>(name.size()));
+        names += name;
+      }
+    }
+
+    AlrSnapshotHeader h{};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.entry_size = sizeof(AlrEntry);
+    h.count = table.size();
+    h.capacity = table.capacity();
+    h.names_offset = sizeof(h);
+    h.names_bytes = names.size();
+    h.slots_offset = (h.names_offset + h.names_bytes + 63) & ~uint64_t{63};
+
+    const std::string tmp = path + ".tmp";
+    {
+      std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+      f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      f.write(names.data(), static_cast<std::streamsize>(names.size()));
+      const std::string pad(h.slots_offset - h.names_offset - h.names_bytes, '\0');
+      f.write(pad.data(), static_cast<std::streamsize>(pad.size()));
+      f.write(reinterpret_cast<const char*>(table.slots()), static_cast<std::streamsize>(table.memory_bytes()));
+      f.flush();
+      if (!f) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("ALR snapshot write failed: " + tmp);
+      }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("ALR snapshot rename failed: " + path + ": " + std::strerror(errno));
+    }
+  }
+
+private:
+  template <typename T>
+  static void append_raw(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  // Intern the three name lists and record snapshot id -> global id.
+  void read_names(const uint8_t* p, size_t len) {
+    const uint8_t* end = p + len;
+    auto take = [&](void* out, size_t n) {
+      if (static_cast<size_t>(end - p) < n) throw std::runtime_error("short");
+      std::memcpy(out, p, n);
+      p += n;
+    };
+    InternPool* pools[3] = {&msc_names(), &vlr_names(), &region_names()};
+    for (size_t k = 0; k < 3; ++k) {
+      uint32_t n = 0;
+      take(&n, sizeof(n));
+      if (n > InternPool::MAX_NAMES) throw std::runtime_error("too many names");
+      ids_[k].clear();
+      ids_[k].reserve(n);
+      for (uint32_t i = 0; i < n; ++i) {
+        uint16_t l = 0;
+        take(&l, sizeof(l));
+        if (static_cast<size_t>(end - p) < l) throw std::runtime_error("short");
+        ids_[k].push_back(pools[k]->intern(std::string_view(reinterpret_cast<const char*>(p), l)));
+        p += l;
+      }
+      // pad so a corrupt entry id still lands on some name, never out of bounds
+      ids_[k].resize(InternPool::MAX_NAMES, ids_[k].empty() ? pools[k]->intern("") : ids_[k][0]);
+    }
+  }
+
+  // Location flag: the ids were set by an update and are already global.
+  static constexpr uint64_t GLOBAL_IDS = uint64_t{1} << 63;
+
+  AlrEntry global(AlrEntry e) const {
+    if (e.location & GLOBAL_IDS) {
+      e.location &= ~GLOBAL_IDS;
+    } else {
+      e.location = alr_location(ids_[0][e.msc()], ids_[1][e.vlr()], ids_[2][e.region()]);
+    }
+    return e;
+  }
+
+  uint8_t* base_{nullptr};
+  size_t size_{0};
+  AlrEntry* slots_{nullptr};
+  size_t cap_{0};
+  size_t count_{0};
+  std::vector<uint16_t> ids_[3]; // snapshot id -> global id: msc, vlr, region
+};
+
+} // namespace tr
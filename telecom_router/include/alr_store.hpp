@@ -1,7 +1,7 @@
 #pragma once
-#include "common.hpp"
+#include "alr_loader.hpp"
+#include "alr_snapshot.hpp"
 #include <optional>
-#include <unordered_map>
 
 namespace tr {
 
@@ -13,31 +13,129 @@ struct AlrRecord {
   std::string region;
 };
 
+// Subscriber store. find() and update_location() may run concurrently from
+// any number of threads, and a lookup never waits for an update. Loading
+// and inserting (everything else that modifies the store) needs it alone.
 class AlrStore {
 public:
   AlrStore() {
     // seed demo data (extend in production by loading from a DB/cache layer)
-    db_["+14085551234"]  = {"310150123456789", "MSC_DALLAS_01", "VLR_DAL_01", "US-SOUTH"};
-    db_["+12125550123"]  = {"310150987654321", "MSC_NYC_01",    "VLR_NYC_01", "US-EAST"};
-    db_["+442079460123"] = {"234150111222333", "MSC_LON_01",    "VLR_LON_01", "UK"};
+    insert("+14085551234",  {"310150123456789", "MSC_DALLAS_01", "VLR_DAL_01", "US-SOUTH"});
+    insert("+12125550123",  {"310150987654321", "MSC_NYC_01",    "VLR_NYC_01", "US-EAST"});
+    insert("+442079460123", {"234150111222333", "MSC_LON_01",    "VLR_LON_01", "UK"});
+  }
+
+  // Serve the subscribers in a snapshot file (alr_snapshot.hpp) from now
+  // on, in place of everything held so far. Throws if the file is missing
+  // or not a snapshot of this version; the store is then left empty.
+  void load_snapshot(const std::string& path) {
+    table_ = AlrTable();
+    snap_.open(path);
+  }
+
+  // Replace everything held with the rows of a provisioning dump (CSV or
+  // TSV, see load_alr_dump), parsed on `threads` threads.
+  AlrLoadStats bulk_load(const std::string& path, size_t threads) {
+    AlrLoadStats stats;
+    AlrTable loaded = load_alr_dump(path, threads, stats);
+    snap_.close();
+    table_ = std::move(loaded);
+    return stats;
+  }
+
+  // Write every subscriber, snapshot and later inserts alike, as a new
+  // snapshot at path.
+  void write_snapshot(const std::string& path) const {
+    if (!snap_.is_open()) {
+      AlrSnapshot::write(path, table_);
+      return;
+    }
+    AlrTable merged;
+    merged.reserve(snap_.size() + table_.size());
+    snap_.for_each([&](const AlrEntry& e) { merged.upsert(e); });
+    for (size_t i = 0; i < table_.capacity(); ++i) {
+      if (table_.slots()[i].msisdn) merged.upsert(table_.slots()[i]);
+    }
+    AlrSnapshot::write(path, merged);
+  }
+
+  // Add or replace the subscriber at msisdn. False (and nothing stored) if
+  // the MSISDN or IMSI is not 1..15 digits.
+  bool insert(std::string_view msisdn, const AlrRecord& rec) {
+    AlrEntry e;
+    e.msisdn = pack_digits(msisdn);
+    e.imsi = pack_digits(rec.imsi);
+    if (e.msisdn == 0 || e.imsi == 0) return false;
+    e.location = alr_location(msc_names().intern(rec.serving_msc), vlr_names().intern(rec.serving_vlr),
+                              region_names().intern(rec.region));
+    table_.upsert(e);
+    return true;
+  }
+
+  // Pre-size for n subscribers before a bulk insert.
+  void reserve(size_t n) { table_.reserve(n); }
+
+  // Subscriber at msisdn, if any; names are ids into the global pools
+  // (msc_names() etc.). Inserts made since the snapshot was loaded win
+  // over it. No allocation.
+  std::optional<AlrEntry> find(std::string_view msisdn) const {
+    const uint64_t key = pack_digits(msisdn);
+    if (const AlrEntry* e = table_.find(key)) return e->load();
+    if (snap_.is_open()) return snap_.find(key);
+    return std::nullopt;
   }
 
   std::optional<AlrRecord> lookup_msisdn(const std::string& msisdn) const {
-    auto it = db_.find(msisdn);
-    if (it == db_.end()) return std::nullopt;
-    return it->second;
+    const auto e = find(msisdn);
+    if (!e) return std::nullopt;
+    char imsi[MAX_PACKED_DIGITS];
+    return AlrRecord{std::string(imsi, unpack_digits(e->imsi, imsi)), std::string(msc_names().name(e->msc())),
+                     std::string(vlr_names().name(e->vlr())), std::string(region_names().name(e->region()))};
   }
 
+  // Location update: the subscriber at msisdn is now served by msc / vlr
+  // (ids into the global pools), and in region unless that is nullopt.
+  // Returns the updated entry, or nullopt if there is no such subscriber
+  // (updates never add one). Each record changes with one atomic store, so
+  // concurrent find()s see either the old location or the new one; for the
+  // same subscriber, the last update wins.
+  std::optional<AlrEntry> update_location(std::string_view msisdn, uint16_t msc, uint16_t vlr,
+                                          std::optional<uint16_t> region) {
+    const uint64_t key = pack_digits(msisdn);
+    if (AlrEntry* e = table_.find_mut(key)) {
+      alr_update_location(*e, [&](uint64_t old) {
+        return alr_location(msc, vlr, region ? *region : AlrEntry{0, 0, old}.region());
+      });
+      return e->load();
+    }
+    if (snap_.is_open() && snap_.update_location(key, msc, vlr, region)) return snap_.find(key);
+    return std::nullopt;
+  }
+
+  // Subscribers held, counting one overriding a snapshot entry twice.
+  size_t size() const { return table_.size() + snap_.size(); }
+  // Heap bytes held by the subscriber table (the name pools are shared and
+  // small, a snapshot is file-backed page cache).
+  size_t memory_bytes() const { return table_.memory_bytes(); }
+
 private:
-  std::unordered_map<std::string, AlrRecord> db_;
+  AlrTable table_; // seeds and inserts; overrides snap_
+  AlrSnapshot snap_;
 };
 
-// Example FLX routing policy decision
-inline std::string route_policy(const AlrRecord& rec) {
+// Example FLX routing policy decision: region id -> route group id, so the
+// per-request work is a couple of integer compares. The ids of the regions
+// and groups it knows are interned once, on first use.
+inline uint16_t route_policy(uint16_t region) {
+  static const uint16_t us_east = region_names().intern("US-EAST");
+  static const uint16_t us_south = region_names().intern("US-SOUTH");
+  static const uint16_t group_east = route_group_names().intern("ROUTE_GROUP_EAST");
+  static const uint16_t group_south = route_group_names().intern("ROUTE_GROUP_SOUTH");
+  static const uint16_t group_intl = route_group_names().intern("ROUTE_GROUP_INTL");
   // pretend policy (could include congestion, priority, roaming)
-  if (rec.region == "US-EAST")  return "ROUTE_GROUP_EAST";
-  if (rec.region == "US-SOUTH") return "ROUTE_GROUP_SOUTH";
-  return "ROUTE_GROUP_INTL";
+  if (region == us_east)  return group_east;
+  if (region == us_south) return group_south;
+  return group_intl;
 }
 
 } // namespace tr
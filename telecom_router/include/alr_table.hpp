@@ -0,0 +1,256 @@
+#pragma once
+#include "common.hpp"
+#include <memory>
+#include <mutex>
+
+namespace tr {
+
+// Up to 15 decimal digits packed into one uint64_t: BCD nibbles from the top,
+// digit count in the low nibble. An E.164 number (leading '+' dropped) or an
+// IMSI fits exactly; 0 never encodes a valid number.
+constexpr size_t MAX_PACKED_DIGITS = 15;
+
+// Packed form of "[+]digits", or 0 if s is not 1..15 digits. Eight digits
+// at a time are checked and packed with 64-bit SWAR (the bulk loader runs
+// this for every row), the tail one by one.
+inline uint64_t pack_digits(std::string_view s) {
+  if (!s.empty() && s[0] == '+') s.remove_prefix(1);
+  if (s.empty() || s.size() > MAX_PACKED_DIGITS) return 0;
+  uint64_t v = 0;
+  size_t i = 0;
+  if (s.size() >= 8) {
+    uint64_t w;
+    std::memcpy(&w, s.data(), 8);
+    constexpr uint64_t HI = 0xF0F0F0F0F0F0F0F0ull, ZEROS = 0x3030303030303030ull;
+    // every byte 0x30..0x39: high nibble 3, and still 3 after adding 6
+    if ((w & HI) != ZEROS || ((w + 0x0606060606060606ull) & HI) != ZEROS) return 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w); // first digit in the top byte
+#endif
+    w &= 0x0F0F0F0F0F0F0F0Full;
+    w = (w | (w >> 4)) & 0x00FF00FF00FF00FFull; // byte pairs -> BCD bytes
+    w = (w | (w >> 8)) & 0x0000FFFF0000FFFFull;
+    v = (w | (w >> 16)) & 0xFFFFFFFFull;
+    i = 8;
+  }
+  for (; i < s.size(); ++i) {
+    const char ch = s[i];
+    if (ch < '0' || ch > '9') return 0;
+    v = (v << 4) | static_cast<uint64_t>(ch - '0');
+  }
+  v <<= 4 * (MAX_PACKED_DIGITS - s.size());
+  return (v << 4) | s.size();
+}
+
+// Write the digits of a packed number to out (room for 15); returns the count.
+inline size_t unpack_digits(uint64_t v, char* out) {
+  const size_t n = v & 0xF;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<char>('0' + ((v >> (4 * (MAX_PACKED_DIGITS - i))) & 0xF));
+  }
+  return n;
+}
+
+// One subscriber, stored inline in the table: 24 bytes, no pointers. The
+// serving MSC / VLR and region are ids into the global name pools
+// (intern_pool.hpp), packed into one word with the bits above 48 free for
+// flags: a location update is a single atomic store of that word and a
+// lookup a single atomic load, so readers never wait on, or see half of,
+// an update. The key and IMSI do not change once a slot is published.
+struct AlrEntry {
+  uint64_t msisdn{0};   // packed key; 0 marks a free slot
+  uint64_t imsi{0};     // packed digits
+  uint64_t location{0}; // alr_location(msc, vlr, region) | flags
+
+  uint16_t msc() const { return static_cast<uint16_t>(location); }
+  uint16_t vlr() const { return static_cast<uint16_t>(location >> 16); }
+  uint16_t region() const { return static_cast<uint16_t>(location >> 32); }
+
+  // Copy with the location read atomically (the slot may be updated).
+  AlrEntry load() const {
+    AlrEntry e = {msisdn, imsi, 0};
+    e.location = __atomic_load_n(&location, __ATOMIC_ACQUIRE);
+    return e;
+  }
+};
+static_assert(sizeof(AlrEntry) == 24, "AlrEntry is the table's slot layout");
+
+constexpr uint64_t ALR_LOCATION_IDS = (uint64_t{1} << 48) - 1;
+
+inline uint64_t alr_location(uint16_t msc, uint16_t vlr, uint16_t region) {
+  return uint64_t{msc} | uint64_t{vlr} << 16 | uint64_t{region} << 32;
+}
+
+// Replace the location word of a published slot with next(old), safely
+// against concurrent readers and other updaters (last writer wins).
+template <typename F>
+inline void alr_update_location(AlrEntry& slot, F&& next) {
+  uint64_t old = __atomic_load_n(&slot.location, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&slot.location, &old, next(old), true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+}
+
+// Home slot of a packed key in a power-of-two table of cap slots. Part of
+// the snapshot format (alr_snapshot.hpp): changing it means a new version.
+inline size_t alr_home(uint64_t key, size_t cap) {
+  // murmur3 finaliser: packed keys share long digit prefixes
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+  return static_cast<size_t>(key) & (cap - 1);
+}
+
+// Linear-probe lookup over slots[0, cap); shared by AlrTable and mapped
+// snapshots. cap must be a power of two. Gives up after cap slots, so a
+// corrupt snapshot without a free slot cannot make a miss spin forever.
+inline const AlrEntry* alr_probe(const AlrEntry* slots, size_t cap, uint64_t key) {
+  if (cap == 0 || key == 0) return nullptr;
+  size_t i = alr_home(key, cap);
+  for (size_t n = 0; n < cap; ++n, i = (i + 1) & (cap - 1)) {
+    const AlrEntry& s = slots[i];
+    if (s.msisdn == key) return &s;
+    if (s.msisdn == 0) return nullptr;
+  }
+  return nullptr;
+}
+
+// Run fn(i) for every i in [0, n) on n threads, fn(0) on the caller's.
+// Every thread is joined before returning; the first exception thrown (by
+// the lowest i, or by failing to start a thread) is then rethrown.
+template <typename F>
+inline void run_on_threads(size_t n, F&& fn) {
+  std::vector<std::exception_ptr> errs(std::max<size_t>(n, 1));
+  auto guarded = [&](size_t i) {
+    try {
+      fn(i);
+    } catch (...) {
+      errs[i] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> pool;
+  try {
+    for (size_t i = 1; i < n; ++i) pool.emplace_back(guarded, i);
+    guarded(0);
+  } catch (...) { // a thread failed to start; the rest still get joined
+    errs[0] = std::current_exception();
+  }
+  for (auto& th : pool) th.join();
+  for (auto& e : errs) {
+    if (e) std::rethrow_exception(e);
+  }
+}
+
+// Open-addressing hash table of AlrEntry keyed by the packed MSISDN: linear
+// probing over a power-of-two array, grown at 3/4 load. A hit costs a hash
+// and usually one cache line; there is no per-entry allocation. No erase
+// (subscribers are re-provisioned, not deleted, between reloads).
+class AlrTable {
+public:
+  AlrTable() = default;
+  AlrTable(AlrTable&&) noexcept = default;
+  AlrTable& operator=(AlrTable&&) noexcept = default;
+
+  // Slots a table holding n entries gets from reserve(n) or build(n, ...).
+  static size_t capacity_for(size_t n) {
+    size_t cap = MIN_CAPACITY;
+    while (cap * 3 / 4 < n) cap <<= 1;
+    return cap;
+  }
+
+  // Size the table for n entries without further growth.
+  void reserve(size_t n) {
+    const size_t cap = capacity_for(n);
+    if (cap > cap_) rehash(cap);
+  }
+
+  // Which of `regions` equal slot ranges (a power of two, at most
+  // capacity_for(n) / 16) a key's home slot falls in, for build().
+  static size_t region_of(uint64_t key, size_t cap, size_t regions) {
+    return alr_home(key, cap) / (cap / regions);
+  }
+
+  // Parallel bulk build of a table for at most n entries. The slot array is
+  // cut into `regions` ranges, filled concurrently by `threads` threads:
+  // feed(r, put) must call put(e) for every entry whose region_of is r, in
+  // input order (a later entry for the same key replaces an earlier one).
+  // Probes stay inside their range; the few that would run past its end
+  // are inserted serially afterwards. An exception from feed is rethrown
+  // once every thread has stopped.
+  template <typename Feed>
+  static AlrTable build(size_t n, size_t regions, size_t threads, Feed&& feed) {
+    AlrTable t;
+    t.rehash(capacity_for(n));
+    const size_t span = t.cap_ / regions;
+    std::atomic<size_t> next{0};
+    std::mutex mu;
+    std::vector<std::vector<AlrEntry>> spill(regions);
+    run_on_threads(threads, [&](size_t) {
+      size_t added = 0;
+      for (size_t r; (r = next.fetch_add(1, std::memory_order_relaxed)) < regions;) {
+        AlrEntry* const end = t.slots_.get() + (r + 1) * span;
+        feed(r, [&](const AlrEntry& e) {
+          for (AlrEntry* s = t.slots_.get() + alr_home(e.msisdn, t.cap_); s != end; ++s) {
+            if (s->msisdn == e.msisdn || s->msisdn == 0) {
+              if (s->msisdn == 0) ++added;
+              *s = e;
+              return;
+            }
+          }
+          spill[r].push_back(e);
+        });
+      }
+      std::lock_guard<std::mutex> lk(mu);
+      t.size_ += added;
+    });
+    for (const auto& v : spill) {
+      for (const AlrEntry& e : v) t.upsert(e);
+    }
+    return t;
+  }
+
+  // Insert or overwrite e (e.msisdn must be a packed key, not 0).
+  void upsert(const AlrEntry& e) {
+    if ((size_ + 1) * 4 > cap_ * 3) rehash(cap_ ? cap_ * 2 : MIN_CAPACITY);
+    AlrEntry& slot = probe(e.msisdn);
+    if (slot.msisdn == 0) ++size_;
+    slot = e;
+  }
+
+  const AlrEntry* find(uint64_t key) const { return alr_probe(slots_.get(), cap_, key); }
+  // Slot for key, for alr_update_location; nullptr if absent.
+  AlrEntry* find_mut(uint64_t key) { return const_cast<AlrEntry*>(find(key)); }
+
+  // Raw slot array (capacity() slots, free ones have msisdn 0).
+  const AlrEntry* slots() const { return slots_.get(); }
+  size_t size() const { return size_; }
+  size_t capacity() const { return cap_; }
+  size_t memory_bytes() const { return cap_ * sizeof(AlrEntry); }
+
+private:
+  static constexpr size_t MIN_CAPACITY = 16;
+
+  AlrEntry& probe(uint64_t key) {
+    for (size_t i = alr_home(key, cap_);; i = (i + 1) & (cap_ - 1)) {
+      AlrEntry& s = slots_[i];
+      if (s.msisdn == key || s.msisdn == 0) return s;
+    }
+  }
+
+  void rehash(size_t cap) {
+    auto old = std::move(slots_);
+    const size_t old_cap = cap_;
+    slots_.reset(new AlrEntry[cap]());
+    cap_ = cap;
+    for (size_t i = 0; i < old_cap; ++i) {
+      if (old[i].msisdn) probe(old[i].msisdn) = old[i];
+    }
+  }
+
+  std::unique_ptr<AlrEntry[]> slots_;
+  size_t cap_{0};
+  size_t size_{0};
+};
+
+} // namespace tr
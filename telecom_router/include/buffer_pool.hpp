@@ -0,0 +1,146 @@
+#pragma once
+#include "common.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace tr {
+
+// Size-classed free lists of byte blocks (256 B .. 64 KiB, powers of two).
+// Connections borrow a block only while they have bytes to hold and give it
+// back as soon as they drain, so an idle connection owns no buffer memory and
+// a burst's large blocks are reused instead of staying pinned to whoever had
+// the burst. Larger requests are allocated exactly and freed on release.
+// Each class keeps at most `retain_bytes` of free blocks. Single-threaded:
+// one pool per reactor.
+class BufferPool {
+public:
+  static constexpr size_t MIN_BLOCK = 256;
+  static constexpr size_t CLASSES = 9;
+  static constexpr size_t MAX_BLOCK = MIN_BLOCK << (CLASSES - 1);
+
+  explicit BufferPool(size_t retain_bytes = size_t{4} << 20) : retain_bytes_(retain_bytes) {}
+
+  ~BufferPool() {
+    for (auto& fl : free_) for (char* b : fl) delete[] b;
+  }
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // Block of at least `want` bytes; its real size is stored in cap.
+  std::unique_ptr<char[]> acquire(size_t want, size_t& cap) {
+    if (want > MAX_BLOCK) {
+      cap = want;
+      return std::unique_ptr<char[]>(new char[want]);
+    }
+    const size_t k = size_class(want);
+    cap = MIN_BLOCK << k;
+    auto& fl = free_[k];
+    if (fl.empty()) return std::unique_ptr<char[]>(new char[cap]);
+    std::unique_ptr<char[]> b(fl.back());
+    fl.pop_back();
+    cached_ -= cap;
+    return b;
+  }
+
+  // Take back a block obtained from acquire() with the cap it reported.
+  void release(std::unique_ptr<char[]> b, size_t cap) {
+    if (!b || cap > MAX_BLOCK) return;
+    const size_t k = size_class(cap);
+    auto& fl = free_[k];
+    if ((fl.size() + 1) * cap > retain_bytes_) return;
+    fl.push_back(b.release());
+    cached_ += cap;
+  }
+
+  // Bytes currently sitting in free lists.
+  size_t cached_bytes() const { return cached_; }
+
+private:
+  static size_t size_class(size_t n) {
+    size_t k = 0;
+    while ((MIN_BLOCK << k) < n) ++k;
+    return k;
+  }
+
+  std::vector<char*> free_[CLASSES];
+  size_t retain_bytes_;
+  size_t cached_{0};
+};
+
+// Linear byte buffer over a pooled block: bytes live in [rd_, wr_), are
+// appended at the tail and consumed from the head. No block is attached until
+// the first prepare(); release() hands it back. Cursors are size_t so a
+// block past 4 GiB cannot wrap them (callers bound what they buffer).
+class ByteBuffer {
+public:
+  ByteBuffer() = default;
+  ByteBuffer(ByteBuffer&&) noexcept = default;
+  ByteBuffer& operator=(ByteBuffer&&) noexcept = default;
+
+  // Writable space for at least `want` bytes at the tail; follow with
+  // commit(). Slides the unconsumed bytes to the front or moves them to a
+  // larger block (at least twice the size) when the tail is short.
+  char* prepare(BufferPool& pool, size_t want) {
+    if (cap_ - wr_ < want) {
+      const size_t live = wr_ - rd_;
+      if (rd_ > 0 && cap_ - live >= want) {
+        std::memmove(buf_.get(), buf_.get() + rd_, live);
+      } else {
+        size_t cap = 0;
+        auto nb = pool.acquire(std::max(live + want, cap_ * 2), cap);
+        if (live) std::memcpy(nb.get(), buf_.get() + rd_, live);
+        pool.release(std::move(buf_), cap_);
+        buf_ = std::move(nb);
+        cap_ = cap;
+      }
+      rd_ = 0;
+      wr_ = live;
+    }
+    return buf_.get() + wr_;
+  }
+
+  void commit(size_t n) { wr_ += n; }
+
+  void append(BufferPool& pool, const char* data, size_t n) {
+    std::memcpy(prepare(pool, n), data, n);
+    commit(n);
+  }
+
+  const char* data() const { return buf_.get() + rd_; }
+  size_t size() const { return wr_ - rd_; }
+  bool empty() const { return rd_ == wr_; }
+
+  void consume(size_t n) {
+    rd_ += n;
+    if (rd_ == wr_) rd_ = wr_ = 0;
+  }
+
+  // Return the block to the pool, dropping any unconsumed bytes.
+  void release(BufferPool& pool) {
+    pool.release(std::move(buf_), cap_);
+    cap_ = rd_ = wr_ = 0;
+  }
+
+  // Convenience for the drain paths: give the block back once nothing is left.
+  void release_if_empty(BufferPool& pool) {
+    if (buf_ && empty()) release(pool);
+  }
+
+  void swap(ByteBuffer& o) noexcept {
+    std::swap(buf_, o.buf_);
+    std::swap(cap_, o.cap_);
+    std::swap(rd_, o.rd_);
+    std::swap(wr_, o.wr_);
+  }
+
+private:
+  std::unique_ptr<char[]> buf_;
+  size_t cap_{0};
+  size_t rd_{0};
+  size_t wr_{0};
+};
+
+} // namespace tr
@@ -42,9 +42,4 @@ inline uint64_t steady_millis() {
   return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
 }
 
-inline uint64_t next_corr_id() {
-  static std::atomic<uint64_t> g{1};
-  return g.fetch_add(1, std::memory_order_relaxed);
-}
-
 } // namespace tr
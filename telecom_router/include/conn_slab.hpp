@@ -0,0 +1,101 @@
+#pragma once
+#include "common.hpp"
+#include <memory>
+#include <utility>
+
+namespace tr {
+
+// Dense table of T addressed by generational ids: the low 32 bits are the
+// slot index, the high 32 bits the slot's generation, which is bumped every
+// time the slot is freed. A stale id (its object was erased, the slot maybe
+// reused) simply fails get(), so ids are safe to hand to other threads or
+// keep in timers. Lookups are an index, no hashing. Slots live in fixed-size
+// chunks, so an object never moves while it is live; freed slots are reused
+// LIFO (the most recently touched memory first). Single-threaded.
+template <class T>
+class ConnSlab {
+public:
+  using Id = uint64_t;
+  static constexpr Id INVALID = ~Id{0};
+
+  // Ids that never name a slot, for callers that share the id space with
+  // other event sources (listen socket, eventfd).
+  static constexpr Id reserved(uint32_t tag) { return (Id{tag} << 32) | NO_SLOT; }
+
+  static constexpr uint32_t index(Id id) { return static_cast<uint32_t>(id); }
+
+  ConnSlab() = default;
+  ConnSlab(const ConnSlab&) = delete;
+  ConnSlab& operator=(const ConnSlab&) = delete;
+
+  // Construct a T in a free slot; returns its id and the object.
+  template <class... Args>
+  std::pair<Id, T&> emplace(Args&&... args) {
+    uint32_t idx;
+    if (!free_.empty()) {
+      idx = free_.back();
+      free_.pop_back();
+    } else {
+      if (next_ == NO_SLOT) throw std::runtime_error("connection slab exhausted");
+      if ((next_ & CHUNK_MASK) == 0) chunks_.emplace_back(new Slot[CHUNK]);
+      idx = next_++;
+    }
+    Slot& s = slot(idx);
+    T& v = s.value.emplace(std::forward<Args>(args)...);
+    ++size_;
+    return {make_id(s.gen, idx), v};
+  }
+
+  // Live object named by id, or nullptr if it was erased since.
+  T* get(Id id) {
+    const uint32_t idx = index(id);
+    if (idx >= next_) return nullptr;
+    Slot& s = slot(idx);
+    if (!s.value || make_id(s.gen, idx) != id) return nullptr;
+    return &*s.value;
+  }
+
+  // Live object in slot idx whatever its generation. Only for callers that
+  // know the slot cannot have been recycled under them (io_uring: a
+  // connection is not erased while SQEs still reference it).
+  T* at(uint32_t idx) {
+    if (idx >= next_) return nullptr;
+    Slot& s = slot(idx);
+    return s.value ? &*s.value : nullptr;
+  }
+
+  // Destroy the object and retire its id. No-op for stale ids.
+  void erase(Id id) {
+    if (!get(id)) return;
+    const uint32_t idx = index(id);
+    Slot& s = slot(idx);
+    s.value.reset();
+    ++s.gen;
+    free_.push_back(idx);
+    --size_;
+  }
+
+  size_t size() const { return size_; }
+
+private:
+  static constexpr uint32_t NO_SLOT = ~uint32_t{0};
+  static constexpr uint32_t CHUNK = 4096;
+  static constexpr uint32_t CHUNK_MASK = CHUNK - 1;
+
+  // One cache line per slot header so neighbouring connections never share
+  // the line holding their hot fields.
+  struct alignas(64) Slot {
+    uint32_t gen{1};
+    std::optional<T> value;
+  };
+
+  static Id make_id(uint32_t gen, uint32_t idx) { return (Id{gen} << 32) | idx; }
+  Slot& slot(uint32_t idx) { return chunks_[idx / CHUNK][idx & CHUNK_MASK]; }
+
+  std::vector<std::unique_ptr<Slot[]>> chunks_;
+  std::vector<uint32_t> free_;
+  uint32_t next_{0}; // slots [0, next_) have been handed out at least once
+  size_t size_{0};
+};
+
+} // namespace tr
@@ -0,0 +1,32 @@
+#pragma once
+#include "protocol.hpp"
+#include <cstring>
+#include <string_view>
+
+namespace tr {
+
+// Ingress frame scanners: they work in place on whatever bytes have arrived
+// and report how much they consumed; the caller keeps the incomplete tail.
+// Binary MsgHdr frames are scanned by scan_msgs (protocol.hpp).
+
+// Call f(std::string_view line) for every '\n'-terminated line in [p, p+n),
+// without the terminator (a trailing '\r' is stripped too; empty lines are
+// skipped). Returns the number of bytes consumed, i.e. up to and including
+// the last '\n'; the remainder is an incomplete frame. Lines are located with
+// memchr, which glibc vectorises, so each byte is examined once.
+template <class F>
+size_t scan_lines(const char* p, size_t n, F&& f) {
+  const char* const begin = p;
+  const char* const end = p + n;
+  while (p < end) {
+    const auto* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+    if (!nl) break;
+    const char* e = nl;
+    while (e > p && e[-1] == '\r') --e;
+    if (e > p) f(std::string_view(p, static_cast<size_t>(e - p)));
+    p = nl + 1;
+  }
+  return static_cast<size_t>(p - begin);
+}
+
+} // namespace tr
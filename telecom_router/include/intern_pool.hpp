@@ -0,0 +1,103 @@
+#pragma once
+#include "common.hpp"
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace tr {
+
+// Process-wide dictionary of the few thousand distinct names an ALR field
+// takes (MSCs, VLRs, regions, route groups). Records hold the 16-bit id;
+// the string is looked up only when a response is rendered. find() and
+// name() are lock-free; intern() takes a lock only to add a name. name() is
+// valid for any id a caller got from intern() or find() (directly or
+// through a record published after it). Names are never removed, so views
+// stay valid for the life of the process, and a pool only grows: untrusted
+// input should go through find(), not intern().
+class InternPool {
+public:
+  static constexpr size_t MAX_NAMES = 65536;
+
+  explicit InternPool(const char* what) : what_(what) {}
+  InternPool(const InternPool&) = delete;
+  InternPool& operator=(const InternPool&) = delete;
+  ~InternPool() {
+    for (auto& c : chunks_) delete c.load(std::memory_order_relaxed);
+  }
+
+  uint16_t intern(std::string_view s) {
+    if (auto id = find(s)) return *id;
+    std::lock_guard<std::mutex> lk(mu_);
+    if (auto id = find(s)) return *id;
+    if (names_.size() == MAX_NAMES) throw std::runtime_error(std::string(what_) + ": more than 65536 names");
+    const std::string& name = names_.emplace_back(s); // deque: never moves
+    const auto id = static_cast<uint16_t>(names_.size() - 1);
+    auto& slot = chunks_[id >> CHUNK_BITS];
+    Chunk* c = slot.load(std::memory_order_relaxed);
+    if (!c) {
+      c = new Chunk();
+      slot.store(c, std::memory_order_release);
+    }
+    c->views[id & (CHUNK - 1)] = name;
+    size_t i = slot_of(name);
+    while (index_[i].load(std::memory_order_relaxed)) i = (i + 1) & (INDEX - 1);
+    index_[i].store(uint32_t{id} + 1, std::memory_order_release);
+    return id;
+  }
+
+  // Id of s if it has been interned.
+  std::optional<uint16_t> find(std::string_view s) const {
+    // at most half the index is used, so the probe always meets a free slot
+    for (size_t i = slot_of(s);; i = (i + 1) & (INDEX - 1)) {
+      const uint32_t v = index_[i].load(std::memory_order_acquire);
+      if (v == 0) return std::nullopt;
+      const auto id = static_cast<uint16_t>(v - 1);
+      if (name(id) == s) return id;
+    }
+  }
+
+  std::string_view name(uint16_t id) const {
+    return chunks_[id >> CHUNK_BITS].load(std::memory_order_acquire)->views[id & (CHUNK - 1)];
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return names_.size();
+  }
+
+private:
+  static constexpr size_t CHUNK_BITS = 8;
+  static constexpr size_t CHUNK = size_t{1} << CHUNK_BITS;
+  static constexpr size_t INDEX = 2 * MAX_NAMES; // open-addressing slots
+  struct Chunk {
+    std::string_view views[CHUNK];
+  };
+
+  static size_t slot_of(std::string_view s) { return std::hash<std::string_view>{}(s) & (INDEX - 1); }
+
+  const char* what_;
+  mutable std::mutex mu_;
+  std::deque<std::string> names_;
+  std::atomic<Chunk*> chunks_[MAX_NAMES / CHUNK]{};
+  std::atomic<uint32_t> index_[INDEX]{}; // id + 1 of a name hashing near the slot; 0 = free
+};
+
+// The pools, one per kind of name so each gets the full 16-bit id space.
+inline InternPool& msc_names() {
+  static InternPool pool("msc_names");
+  return pool;
+}
+inline InternPool& vlr_names() {
+  static InternPool pool("vlr_names");
+  return pool;
+}
+inline InternPool& region_names() {
+  static InternPool pool("region_names");
+  return pool;
+}
+inline InternPool& route_group_names() {
+  static InternPool pool("route_group_names");
+  return pool;
+}
+
+} // namespace tr
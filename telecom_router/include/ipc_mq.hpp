@@ -88,6 +88,10 @@ public:
   long msgsize() const { return cfg_.msgsize; }
   const MqConfig& cfg() const { return cfg_; }
 
+  // On Linux an mqd_t is a file descriptor: it can sit in epoll/poll and
+  // reports EPOLLIN while messages are queued (EPOLLOUT while there is room).
+  int fd() const { return static_cast<int>(mqd_); }
+
 private:
   mqd_t mqd_{(mqd_t)-1};
   MqConfig cfg_{};
@@ -0,0 +1,91 @@
+#pragma once
+#include "common.hpp"
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace tr {
+
+// Bounded lock-free multi-producer/multi-consumer ring (Vyukov): each cell
+// carries a sequence number that says whose turn it is, so producers and
+// consumers only contend on their own index. Capacity rounds up to a power
+// of two; try_push fails when full, try_pop when empty. A cell is owned
+// exclusively between the index CAS and the sequence store, so T may be
+// move-only; a failed try_push leaves its argument untouched.
+template <class T>
+class MpmcRing {
+  static_assert(std::is_nothrow_move_assignable<T>::value, "MpmcRing values are moved in and out of cells");
+
+public:
+  explicit MpmcRing(size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+    mask_ = cap - 1;
+    cells_.reset(new Cell[cap]);
+    for (size_t i = 0; i < cap; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  MpmcRing(const MpmcRing&) = delete;
+  MpmcRing& operator=(const MpmcRing&) = delete;
+
+  template <class U>
+  bool try_push(U&& v) {
+    size_t pos = enq_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c = cells_[pos & mask_];
+      const size_t seq = c.seq.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (enq_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.value = std::forward<U>(v);
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enq_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T& out) {
+    size_t pos = deq_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c = cells_[pos & mask_];
+      const size_t seq = c.seq.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (deq_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          out = std::move(c.value);
+          c.seq.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = deq_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Racy snapshot; only meaningful as a hint.
+  bool empty() const {
+    return deq_.load(std::memory_order_acquire) >= enq_.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct alignas(64) Cell {
+    std::atomic<size_t> seq{0};
+    T value{};
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_{0};
+  alignas(64) std::atomic<size_t> enq_{0};
+  alignas(64) std::atomic<size_t> deq_{0};
+};
+
+} // namespace tr
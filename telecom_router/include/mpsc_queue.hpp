@@ -0,0 +1,74 @@
+#pragma once
+#include "common.hpp"
+#include "mpmc_ring.hpp"
+#include <utility>
+
+namespace tr {
+
+// Unbounded lock-free multi-producer/single-consumer queue (Vyukov). push is
+// one atomic exchange and never waits on the consumer or other producers;
+// pop is consumer-only. Unbounded on purpose: producers are threads that
+// must never block on the consumer (a full queue could deadlock against it).
+//
+// Consumed nodes go back to a bounded free ring for later pushes, and pop()
+// swaps values out rather than moving them, so a node keeps whatever capacity
+// its value had (a string's buffer, say). A steady flow through push_with()
+// then allocates nothing.
+template <class T>
+class MpscQueue {
+public:
+  explicit MpscQueue(size_t spare_nodes = 1024)
+      : head_(new Node), tail_(head_.load(std::memory_order_relaxed)), spare_(spare_nodes) {}
+
+  ~MpscQueue() {
+    T v;
+    while (pop(v)) {}
+    delete tail_;
+    Node* n = nullptr;
+    while (spare_.try_pop(n)) delete n;
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Any thread.
+  void push(T v) {
+    push_with([&](T& slot) { slot = std::move(v); });
+  }
+
+  // Any thread: fill(T&) writes the value in place, into a recycled node's
+  // previous value when there is one.
+  template <class F>
+  void push_with(F&& fill) {
+    Node* n = nullptr;
+    if (!spare_.try_pop(n)) n = new Node;
+    n->next.store(nullptr, std::memory_order_relaxed);
+    fill(n->value);
+    Node* prev = head_.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+  // Consumer only. false when empty (or a push is still linking its node).
+  // out's previous value is left in the node for reuse.
+  bool pop(T& out) {
+    Node* next = tail_->next.load(std::memory_order_acquire);
+    if (!next) return false;
+    using std::swap;
+    swap(out, next->value);
+    if (!spare_.try_push(tail_)) delete tail_;
+    tail_ = next; // next becomes the new (value-less) sentinel
+    return true;
+  }
+
+private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    T value{};
+  };
+
+  alignas(64) std::atomic<Node*> head_; // producers
+  alignas(64) Node* tail_;              // consumer: sentinel before the oldest value
+  MpmcRing<Node*> spare_;               // consumer pushes, producers pop
+};
+
+} // namespace tr
@@ -0,0 +1,129 @@
+#pragma once
+#include "common.hpp"
+#include <memory>
+#include <type_traits>
+
+namespace tr {
+
+// Preallocated, lock-free table of in-flight transactions.
+//
+// The correlation id *is* the table address: the low bits select a slot and
+// the high bits carry that slot's generation. A slot's generation is bumped
+// every time it is released, so a late or duplicate response for a reused
+// slot fails the generation check instead of completing someone else's
+// transaction. insert/take are O(1): no hashing, no allocation, no rehash.
+//
+// take() is the single point of completion: exactly one caller (response,
+// timeout, send failure) wins the CAS for a given corr_id.
+template <class T>
+class PendingTable {
+  static_assert(std::is_trivially_copyable<T>::value, "PendingTable values are copied racily");
+
+public:
+  explicit PendingTable(size_t capacity) {
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    if (cap > NIL) throw std::runtime_error("PendingTable capacity too large");
+    cap_ = cap;
+    slot_bits_ = 0;
+    while ((size_t{1} << slot_bits_) < cap_) ++slot_bits_;
+    gen_mask_ = (slot_bits_ == 0) ? ~uint64_t{0} : (~uint64_t{0} >> slot_bits_);
+
+    slots_.reset(new Slot[cap_]);
+    for (size_t i = 0; i < cap_; ++i) {
+      slots_[i].tag.store(make_tag(1, FREE), std::memory_order_relaxed);
+      slots_[i].next.store(i + 1 < cap_ ? static_cast<uint32_t>(i + 1) : NIL, std::memory_order_relaxed);
+    }
+    free_head_.store(pack_head(0, 0), std::memory_order_release);
+  }
+
+  PendingTable(const PendingTable&) = delete;
+  PendingTable& operator=(const PendingTable&) = delete;
+
+  // Store v in a free slot; returns its corr_id, or nullopt when full.
+  std::optional<uint64_t> insert(const T& v) {
+    const uint32_t idx = pop_free();
+    if (idx == NIL) return std::nullopt;
+    Slot& s = slots_[idx];
+    const uint64_t gen = tag_gen(s.tag.load(std::memory_order_relaxed));
+    s.value = v;
+    s.tag.store(make_tag(gen, LIVE), std::memory_order_release);
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return ((gen & gen_mask_) << slot_bits_) | idx;
+  }
+
+  // Remove and return the value for corr_id. nullopt if the slot was never
+  // used, already completed, or reused since (stale generation).
+  std::optional<T> take(uint64_t corr_id) {
+    const uint32_t idx = static_cast<uint32_t>(corr_id & (cap_ - 1));
+    const uint64_t gen = corr_id >> slot_bits_;
+    Slot& s = slots_[idx];
+
+    uint64_t tag = s.tag.load(std::memory_order_acquire);
+    for (;;) {
+      if (tag_state(tag) != LIVE || (tag_gen(tag) & gen_mask_) != gen) return std::nullopt;
+      if (s.tag.compare_exchange_weak(tag, make_tag(tag_gen(tag), BUSY),
+                                      std::memory_order_acquire, std::memory_order_acquire)) {
+        break;
+      }
+    }
+    const T v = s.value;
+    s.tag.store(make_tag(tag_gen(tag) + 1, FREE), std::memory_order_release);
+    push_free(idx);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return v;
+  }
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  size_t capacity() const { return cap_; }
+
+private:
+  static constexpr uint32_t NIL = 0xFFFFFFFFu;
+  enum : uint64_t { FREE = 0, LIVE = 1, BUSY = 2 };
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> tag{0}; // generation << 2 | state
+    std::atomic<uint32_t> next{NIL};
+    T value{};
+  };
+
+  static uint64_t make_tag(uint64_t gen, uint64_t st) { return (gen << 2) | st; }
+  static uint64_t tag_gen(uint64_t tag) { return tag >> 2; }
+  static uint64_t tag_state(uint64_t tag) { return tag & 3; }
+
+  // Free list: Treiber stack; the head carries an ABA counter in the high half.
+  static uint64_t pack_head(uint32_t aba, uint32_t idx) { return (static_cast<uint64_t>(aba) << 32) | idx; }
+
+  uint32_t pop_free() {
+    uint64_t head = free_head_.load(std::memory_order_acquire);
+    for (;;) {
+      const uint32_t idx = static_cast<uint32_t>(head);
+      if (idx == NIL) return NIL;
+      const uint32_t next = slots_[idx].next.load(std::memory_order_relaxed);
+      if (free_head_.compare_exchange_weak(head, pack_head(static_cast<uint32_t>(head >> 32) + 1, next),
+                                           std::memory_order_acquire, std::memory_order_acquire)) {
+        return idx;
+      }
+    }
+  }
+
+  void push_free(uint32_t idx) {
+    uint64_t head = free_head_.load(std::memory_order_relaxed);
+    for (;;) {
+      slots_[idx].next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+      if (free_head_.compare_exchange_weak(head, pack_head(static_cast<uint32_t>(head >> 32) + 1, idx),
+                                           std::memory_order_release, std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t cap_{0};
+  unsigned slot_bits_{0};
+  uint64_t gen_mask_{0};
+  alignas(64) std::atomic<uint64_t> free_head_{pack_head(0, NIL)};
+  alignas(64) std::atomic<size_t> size_{0};
+};
+
+} // namespace tr
@@ -1,48 +1,281 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace tr {
 
+constexpr uint32_t MSG_MAGIC = 0x54524D51; // 'TRMQ'
+
 // MQ message type
 enum class MsgType : uint16_t {
-  RouteReq  = 1,
-  RouteResp = 2
+  RouteReq        = 1, // JSON payload, any op (route, update_location)
+  RouteResp       = 2,
+  RouteReqBin     = 3, // BinRouteReq payload
+  RouteRespBin    = 4, // BinRouteResp payload
+  Batch           = 5, // envelope: complete messages back to back; corr_id = count
+  UpdateLocReqBin = 6  // BinUpdateLocReq payload, answered with RouteRespBin
 };
 
 #pragma pack(push, 1)
 struct MsgHdr {
-  uint32_t magic{0x54524D51};   // 'TRMQ'
+  uint32_t magic{MSG_MAGIC};
   uint16_t version{1};
   uint16_t type{0};
   uint64_t corr_id{0};
   uint32_t payload_len{0};
   uint32_t reserved{0};
 };
+
+// Fixed-layout route request/response. A binary TCP client sends the same
+// MsgHdr + payload frames as the MQ leg (little-endian), with corr_id as its
+// own request tag; the server forwards them to FLX with only corr_id swapped.
+// Strings are NUL-padded and not terminated when they fill the field.
+struct BinRouteReq {
+  char msisdn[16]{};
+  uint32_t timeout_ms{0}; // 0 = server default
+  uint32_t reserved{0};
+};
+
+// Location update: the subscriber is now served by serving_msc /
+// serving_vlr, and in region unless that is empty. The answer is a
+// BinRouteResp describing the subscriber after the update.
+struct BinUpdateLocReq {
+  char msisdn[16]{};
+  uint32_t timeout_ms{0}; // 0 = server default
+  uint32_t reserved{0};
+  char serving_msc[32]{};
+  char serving_vlr[32]{};
+  char region[32]{};
+};
+
+struct BinRouteResp {
+  uint16_t status{0}; // RouteStatus
+  uint16_t reason{0}; // RouteReason
+  uint32_t flx_latency_ms{0};
+  char imsi[16]{};
+  char serving_msc[32]{};
+  char serving_vlr[32]{};
+  char route_group[32]{};
+};
 #pragma pack(pop)
+static_assert(offsetof(BinUpdateLocReq, serving_msc) == sizeof(BinRouteReq), "BinRouteReq is BinUpdateLocReq's prefix");
 
-inline std::vector<uint8_t> pack(MsgType t, uint64_t corr_id, const std::string& payload) {
+enum class RouteStatus : uint16_t { Ok = 0, NotFound = 1, Busy = 2, Timeout = 3, Error = 4 };
+
+enum class RouteReason : uint16_t {
+  None = 0,
+  NotInAlr = 1,
+  Overload = 2,
+  FlxNoResponse = 3,
+  MqFull = 4,
+  MqSend = 5,
+  BadRequest = 6,
+  NoShard = 7,
+  UnknownName = 8 // location update naming an MSC/VLR/region never provisioned
+};
+
+// JSON spelling of the codes
+inline const char* status_name(RouteStatus s) {
+  switch (s) {
+    case RouteStatus::Ok: return "OK";
+    case RouteStatus::NotFound: return "NOT_FOUND";
+    case RouteStatus::Busy: return "BUSY";
+    case RouteStatus::Timeout: return "TIMEOUT";
+    case RouteStatus::Error: return "ERROR";
+  }
+  return "ERROR";
+}
+
+inline const char* reason_name(RouteReason r) {
+  switch (r) {
+    case RouteReason::None: return "";
+    case RouteReason::NotInAlr: return "subscriber_not_in_alr";
+    case RouteReason::Overload: return "overload";
+    case RouteReason::FlxNoResponse: return "flx_no_response";
+    case RouteReason::MqFull: return "mq_full";
+    case RouteReason::MqSend: return "mq_send";
+    case RouteReason::BadRequest: return "bad_request";
+    case RouteReason::NoShard: return "shard_unavailable";
+    case RouteReason::UnknownName: return "unknown_name";
+  }
+  return "";
+}
+
+// Fixed-size string fields
+template <size_t N>
+std::string_view fixed_str(const char (&f)[N]) {
+  size_t n = 0;
+  while (n < N && f[n]) ++n;
+  return std::string_view(f, n);
+}
+
+template <size_t N>
+void set_fixed(char (&f)[N], std::string_view s) {
+  const size_t n = s.size() < N ? s.size() : N;
+  std::memcpy(f, s.data(), n);
+  std::memset(f + n, 0, N - n);
+}
+
+// Encode a message in place: header then payload into out[0, cap). Returns
+// the bytes written, or 0 (nothing written) if cap is too small.
+inline size_t pack_into(void* out, size_t cap, MsgType t, uint64_t corr_id, std::string_view payload) {
+  const size_t len = sizeof(MsgHdr) + payload.size();
+  if (cap < len) return 0;
   MsgHdr h;
   h.type = static_cast<uint16_t>(t);
   h.corr_id = corr_id;
   h.payload_len = static_cast<uint32_t>(payload.size());
+  auto* p = static_cast<char*>(out);
+  std::memcpy(p, &h, sizeof(MsgHdr));
+  if (!payload.empty()) std::memcpy(p + sizeof(MsgHdr), payload.data(), payload.size());
+  return len;
+}
 
+// A received message: its validated header and the payload, viewed in the
+// receive buffer (valid only as long as that buffer is).
+struct MsgView {
+  MsgHdr hdr;
+  std::string_view payload;
+};
+
+// Decode without copying. nullopt unless data is exactly one well-formed
+// message (magic, version, length).
+inline std::optional<MsgView> unpack_view(const void* data, size_t len) {
+  if (len < sizeof(MsgHdr)) return std::nullopt;
+  MsgView m;
+  std::memcpy(&m.hdr, data, sizeof(MsgHdr));
+  if (m.hdr.magic != MSG_MAGIC || m.hdr.version != 1) return std::nullopt;
+  if (sizeof(MsgHdr) + m.hdr.payload_len != len) return std::nullopt;
+  m.payload = std::string_view(static_cast<const char*>(data) + sizeof(MsgHdr), m.hdr.payload_len);
+  return m;
+}
+
+// Allocating wrapper over pack_into().
+inline std::vector<uint8_t> pack(MsgType t, uint64_t corr_id, const std::string& payload) {
   std::vector<uint8_t> out(sizeof(MsgHdr) + payload.size());
-  std::memcpy(out.data(), &h, sizeof(MsgHdr));
-  if (!payload.empty()) {
-    std::memcpy(out.data() + sizeof(MsgHdr), payload.data(), payload.size());
-  }
+  (void)pack_into(out.data(), out.size(), t, corr_id, payload);
   return out;
 }
 
+// Call f(const MsgHdr&, std::string_view frame) for every complete MsgHdr +
+// payload frame in [p, p+n). Returns the bytes consumed; a header with the
+// wrong magic/version or a payload over max_payload sets bad and stops
+// (the stream cannot be resynchronised).
+template <class F>
+size_t scan_msgs(const char* p, size_t n, size_t max_payload, bool& bad, F&& f) {
+  size_t off = 0;
+  while (n - off >= sizeof(MsgHdr)) {
+    MsgHdr h;
+    std::memcpy(&h, p + off, sizeof(MsgHdr));
+    if (h.magic != MSG_MAGIC || h.version != 1 || h.payload_len > max_payload) {
+      bad = true;
+      break;
+    }
+    const size_t len = sizeof(MsgHdr) + h.payload_len;
+    if (n - off < len) break;
+    f(h, std::string_view(p + off, len));
+    off += len;
+  }
+  return off;
+}
+
+// Call f(const MsgHdr&, std::string_view payload) for every record of a Batch
+// envelope's payload. False if the payload is not a clean sequence of
+// messages.
+template <class F>
+bool unpack_batch(std::string_view payload, F&& f) {
+  bool bad = false;
+  const size_t used = scan_msgs(payload.data(), payload.size(), payload.size(), bad,
+                                [&](const MsgHdr& h, std::string_view m) { f(h, m.substr(sizeof(MsgHdr))); });
+  return !bad && used == payload.size();
+}
+
+// Packs messages into one Batch envelope of at most max_bytes, so a burst
+// costs one send instead of one per message. seal() / take() yield the message
+// to send: the envelope, or a lone record as itself. The buffer keeps its
+// capacity across seal()+clear() and can be handed a recycled one after
+// take(), so a steady flow of batches allocates nothing.
+class BatchBuilder {
+public:
+  explicit BatchBuilder(size_t max_bytes = 0) : max_(max_bytes) {}
+
+  // Whether msg_len more bytes still fit; an empty builder takes anything.
+  bool fits(size_t msg_len) const { return n_ == 0 || buf_.size() + msg_len <= max_; }
+
+  // Append a complete message.
+  void add(std::string_view msg) { std::memcpy(grow(msg.size()), msg.data(), msg.size()); }
+
+  // Append a message encoded in place (pack_into).
+  void add(MsgType t, uint64_t corr_id, std::string_view payload) {
+    const size_t len = sizeof(MsgHdr) + payload.size();
+    (void)pack_into(grow(len), len, t, corr_id, payload);
+  }
+
+  size_t count() const { return n_; }
+  bool empty() const { return n_ == 0; }
+
+  // The message to send, valid until the next add() / clear(). Empty if
+  // nothing was added.
+  std::string_view seal() {
+    if (n_ == 0) return {};
+    if (n_ == 1) return std::string_view(buf_).substr(sizeof(MsgHdr));
+    MsgHdr h;
+    h.type = static_cast<uint16_t>(MsgType::Batch);
+    h.corr_id = n_;
+    h.payload_len = static_cast<uint32_t>(buf_.size() - sizeof(MsgHdr));
+    std::memcpy(buf_.data(), &h, sizeof(MsgHdr));
+    return buf_;
+  }
+
+  // Start over, keeping the buffer.
+  void clear() {
+    buf_.clear();
+    n_ = 0;
+  }
+
+  // The message to send, as an owned string; the builder is left without a
+  // buffer (see recycle()).
+  std::string take() {
+    std::string out;
+    if (n_ == 1) buf_.erase(0, sizeof(MsgHdr));
+    else (void)seal();
+    if (n_ > 0) out.swap(buf_);
+    clear();
+    return out;
+  }
+
+  // Adopt spare's capacity for the next batch (only while empty).
+  void recycle(std::string&& spare) {
+    if (n_ != 0 || buf_.capacity() >= spare.capacity()) return;
+    spare.clear();
+    buf_.swap(spare);
+  }
+
+private:
+  char* grow(size_t len) {
+    if (buf_.empty()) buf_.resize(sizeof(MsgHdr)); // envelope header, filled by seal()
+    const size_t at = buf_.size();
+    buf_.resize(at + len);
+    ++n_;
+    return buf_.data() + at;
+  }
+
+  std::string buf_;
+  size_t max_;
+  size_t n_{0};
+};
+
+// Copying wrapper over unpack_view().
 inline bool unpack(const uint8_t* data, size_t len, MsgHdr& h, std::string& payload) {
-  if (len < sizeof(MsgHdr)) return false;
-  std::memcpy(&h, data, sizeof(MsgHdr));
-  if (h.magic != 0x54524D51 || h.version != 1) return false;
-  if (sizeof(MsgHdr) + h.payload_len != len) return false;
-  payload.assign(reinterpret_cast<const char*>(data + sizeof(MsgHdr)), h.payload_len);
+  const auto m = unpack_view(data, len);
+  if (!m) return false;
+  h = m->hdr;
+  payload.assign(m->payload);
   return true;
 }
 
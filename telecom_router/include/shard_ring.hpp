@@ -0,0 +1,70 @@
+#pragma once
+#include "common.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace tr {
+
+// 64-bit FNV-1a over the digits of an MSISDN only, so "+1 408-555-1234" and
+// "14085551234" land on the same shard, finished with a murmur-style mix so
+// numbers sharing a long prefix still spread over the whole ring.
+inline uint64_t msisdn_hash(std::string_view msisdn) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (char ch : msisdn) {
+    if (ch < '0' || ch > '9') continue;
+    h ^= static_cast<unsigned char>(ch);
+    h *= 0x100000001b3ull;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Consistent-hash ring of shard ids. Each shard owns `vnodes` points on a
+// 64-bit circle and a key belongs to the first point at or after its hash,
+// so adding or removing a shard only moves the keys on the arcs that shard
+// gains or gives up (about 1/N of them); everything else stays put. A ring
+// is built once per membership: the server publishes a new one per change.
+class HashRing {
+public:
+  explicit HashRing(uint32_t vnodes = 128) : vnodes_(vnodes) {}
+
+  // False if the shard is already on the ring.
+  bool add(uint32_t shard) {
+    if (contains(shard)) return false;
+    for (uint32_t v = 0; v < vnodes_; ++v) points_.emplace_back(point(shard, v), shard);
+    std::sort(points_.begin(), points_.end());
+    return true;
+  }
+
+  bool contains(uint32_t shard) const {
+    return std::any_of(points_.begin(), points_.end(), [&](const auto& p) { return p.second == shard; });
+  }
+
+  // Shard owning key hash h. The ring must not be empty.
+  uint32_t pick(uint64_t h) const {
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(h, uint32_t{0}));
+    if (it == points_.end()) it = points_.begin();
+    return it->second;
+  }
+
+  bool empty() const { return points_.empty(); }
+
+private:
+  // Ring position of a shard's v-th point; a pure function of (shard, v), so
+  // every process that builds the same membership builds the same ring.
+  static uint64_t point(uint32_t shard, uint32_t v) {
+    uint64_t x = (uint64_t{shard} << 32 | v) + 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  uint32_t vnodes_;
+  std::vector<std::pair<uint64_t, uint32_t>> points_; // sorted by position
+};
+
+} // namespace tr
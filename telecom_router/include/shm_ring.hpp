@@ -0,0 +1,308 @@
+#pragma once
+#include "common.hpp"
+#include "ipc_mq.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace tr {
+
+// Cross-process eventcount: a waiter only enters the kernel after announcing
+// itself, and a notifier only issues FUTEX_WAKE when someone has announced.
+// Busy producers and consumers therefore never make a syscall.
+struct ShmEventCount {
+  std::atomic<uint32_t> seq{0};
+  std::atomic<uint32_t> waiters{0};
+
+  void notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0) return;
+    seq.fetch_add(1, std::memory_order_release);
+    (void)syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+  }
+
+  // Sleep until notified, ready() turns true, or timeout_ms (<0: forever).
+  template <class Ready>
+  void wait(Ready&& ready, int timeout_ms) {
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    const uint32_t s = seq.load(std::memory_order_acquire);
+    if (!ready()) {
+      timespec ts{};
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000L;
+      (void)syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAIT, s,
+                    timeout_ms < 0 ? nullptr : &ts, nullptr, 0);
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+  }
+};
+
+// Message transport over a POSIX shared-memory segment: a bounded lock-free
+// MPMC ring of fixed-size cells (Vyukov sequence numbers). Same open/send/recv
+// shape as PosixMq and configured with the same MqConfig; maxmsg becomes the
+// cell count (rounded up to a power of two) and msgsize the cell capacity.
+//
+// The in-place API (try_reserve/commit, try_peek/release) lets callers build
+// and parse messages directly in the shared cells without an extra copy.
+class ShmQueue {
+public:
+  struct Reservation {
+    uint8_t* data{nullptr};
+    size_t cap{0};
+    uint64_t pos{0};
+  };
+  struct View {
+    const uint8_t* data{nullptr};
+    size_t len{0};
+    uint64_t pos{0};
+  };
+
+  ShmQueue() = default;
+  ~ShmQueue() { close(); }
+
+  ShmQueue(const ShmQueue&) = delete;
+  ShmQueue& operator=(const ShmQueue&) = delete;
+
+  void open(const MqConfig& cfg) {
+    close();
+    cfg_ = cfg;
+
+    uint32_t cells = 1;
+    while (cells < static_cast<uint64_t>(std::max<long>(cfg.maxmsg, 1))) cells <<= 1;
+    const size_t stride = cell_stride(static_cast<size_t>(cfg.msgsize));
+    const size_t want = sizeof(Header) + static_cast<size_t>(cells) * stride;
+
+    int fd = shm_open(cfg.name.c_str(), O_RDWR | (cfg.create ? O_CREAT : 0), 0660);
+    if (fd < 0) {
+      throw std::runtime_error("shm_open failed for " + cfg.name + ": " + std::string(std::strerror(errno)));
+    }
+    size_t size = want;
+    if (cfg.create) {
+      // The creator owns the layout: reset any stale segment from a prior run.
+      if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(want)) != 0) {
+        ::close(fd);
+        throw std::runtime_error("shm ftruncate failed for " + cfg.name);
+      }
+    } else {
+      struct stat st{};
+      if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        throw std::runtime_error("shm segment not initialised: " + cfg.name);
+      }
+      size = static_cast<size_t>(st.st_size);
+    }
+
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("shm mmap failed for " + cfg.name);
+    base_ = static_cast<uint8_t*>(p);
+    size_ = size;
+    hdr_ = reinterpret_cast<Header*>(base_);
+
+    if (cfg.create) {
+      new (hdr_) Header();
+      hdr_->cells = cells;
+      hdr_->cell_size = static_cast<uint32_t>(cfg.msgsize);
+      hdr_->stride = static_cast<uint32_t>(stride);
+      for (uint32_t i = 0; i < cells; ++i) {
+        new (cell(i)) Cell();
+        cell(i)->seq.store(i, std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+      hdr_->magic = MAGIC; // published last: openers check it
+    } else if (hdr_->magic != MAGIC || hdr_->version != VERSION ||
+               size_ < sizeof(Header) + static_cast<size_t>(hdr_->cells) * hdr_->stride) {
+      close();
+      throw std::runtime_error("shm segment layout mismatch: " + cfg.name);
+    }
+    mask_ = hdr_->cells - 1;
+  }
+
+  void close() {
+    if (base_) { munmap(base_, size_); base_ = nullptr; hdr_ = nullptr; }
+  }
+
+  void unlink_queue() {
+    if (!cfg_.name.empty()) shm_unlink(cfg_.name.c_str());
+  }
+
+  // ---- in-place API ----
+
+  // Claim a free cell to build a message in; false when the ring is full.
+  bool try_reserve(Reservation& r) {
+    uint64_t pos = hdr_->enq.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell* c = cell(pos & mask_);
+      const uint64_t seq = c->seq.load(std::memory_order_acquire);
+      const int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+      if (diff == 0) {
+        if (hdr_->enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          r.data = c->data();
+          r.cap = hdr_->cell_size;
+          r.pos = pos;
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = hdr_->enq.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void commit(const Reservation& r, size_t len) {
+    Cell* c = cell(r.pos & mask_);
+    c->len = static_cast<uint32_t>(len);
+    c->seq.store(r.pos + 1, std::memory_order_release);
+    hdr_->not_empty.notify();
+  }
+
+  // Borrow the oldest message in place; false when the ring is empty.
+  bool try_peek(View& v) {
+    uint64_t pos = hdr_->deq.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell* c = cell(pos & mask_);
+      const uint64_t seq = c->seq.load(std::memory_order_acquire);
+      const int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos + 1);
+      if (diff == 0) {
+        if (hdr_->deq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          v.data = c->data();
+          v.len = c->len;
+          v.pos = pos;
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = hdr_->deq.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void release(const View& v) {
+    cell(v.pos & mask_)->seq.store(v.pos + mask_ + 1, std::memory_order_release);
+    hdr_->not_full.notify();
+  }
+
+  // Block (spin briefly, then futex) until a message is available or
+  // timeout_ms elapses (<0: forever).
+  bool peek(View& v, int timeout_ms) {
+    for (int i = 0; i < SPIN; ++i) {
+      if (try_peek(v)) return true;
+    }
+    const uint64_t deadline = steady_millis() + static_cast<uint64_t>(std::max(timeout_ms, 0));
+    for (;;) {
+      if (try_peek(v)) return true;
+      int left = -1;
+      if (timeout_ms >= 0) {
+        const uint64_t now = steady_millis();
+        if (now >= deadline) return false;
+        left = static_cast<int>(deadline - now);
+      }
+      hdr_->not_empty.wait([&] { return !empty(); }, left);
+    }
+  }
+
+  // Park (after a short spin) until the ring looks non-empty or timeout_ms
+  // elapses; consumes nothing. Several consumers may be woken for one message.
+  bool wait_nonempty(int timeout_ms) {
+    for (int i = 0; i < SPIN; ++i) {
+      if (!empty()) return true;
+    }
+    hdr_->not_empty.wait([&] { return !empty(); }, timeout_ms);
+    return !empty();
+  }
+
+  // try_peek or a bounded peek, depending on cfg.nonblock
+  bool wait_peek(View& v) { return cfg_.nonblock ? try_peek(v) : peek(v, IDLE_WAIT_MS); }
+
+  // ---- PosixMq-compatible API ----
+
+  bool send(const uint8_t* data, size_t len, unsigned prio = 0) {
+    if (!hdr_) return false;
+    if (len > hdr_->cell_size) throw std::runtime_error("shm send message too large");
+    Reservation r;
+    while (!try_reserve(r)) {
+      if (cfg_.nonblock) return false;
+      hdr_->not_full.wait([&] { return !full(); }, 100);
+    }
+    std::memcpy(r.data, data, len);
+    commit(r, len);
+    return true;
+  }
+
+  // blocking receive unless nonblock configured; a blocking wait gives up
+  // with -1 after IDLE_WAIT_MS so callers can notice shutdown
+  ssize_t recv(uint8_t* buf, size_t cap, unsigned* prio = nullptr) {
+    if (!hdr_) return -1;
+    if (cap < hdr_->cell_size) throw std::runtime_error("recv buffer too small");
+    View v;
+    if (!wait_peek(v)) return -1;
+    std::memcpy(buf, v.data, v.len);
+    const auto n = static_cast<ssize_t>(v.len);
+    release(v);
+    if (prio) *prio = 0;
+    return n;
+  }
+
+  long msgsize() const { return cfg_.msgsize; }
+  const MqConfig& cfg() const { return cfg_; }
+
+private:
+  static constexpr uint32_t MAGIC = 0x54525348; // 'TRSH'
+  static constexpr uint32_t VERSION = 1;
+  static constexpr int SPIN = 256;
+  static constexpr int IDLE_WAIT_MS = 200;
+
+  struct Header {
+    uint32_t magic{0};
+    uint32_t version{VERSION};
+    uint32_t cells{0};
+    uint32_t cell_size{0};
+    uint32_t stride{0};
+    alignas(64) std::atomic<uint64_t> enq{0};
+    alignas(64) std::atomic<uint64_t> deq{0};
+    alignas(64) ShmEventCount not_empty;
+    alignas(64) ShmEventCount not_full;
+  };
+
+  struct alignas(64) Cell {
+    std::atomic<uint64_t> seq{0};
+    uint32_t len{0};
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(this) + sizeof(Cell); }
+  };
+
+  static size_t cell_stride(size_t msgsize) {
+    return (sizeof(Cell) + msgsize + 63) & ~size_t{63};
+  }
+
+  Cell* cell(uint64_t i) const {
+    return reinterpret_cast<Cell*>(base_ + sizeof(Header) + static_cast<size_t>(i) * hdr_->stride);
+  }
+
+  bool empty() const {
+    const uint64_t pos = hdr_->deq.load(std::memory_order_relaxed);
+    return cell(pos & mask_)->seq.load(std::memory_order_acquire) != pos + 1;
+  }
+  bool full() const {
+    const uint64_t pos = hdr_->enq.load(std::memory_order_relaxed);
+    return cell(pos & mask_)->seq.load(std::memory_order_acquire) != pos;
+  }
+
+  uint8_t* base_{nullptr};
+  size_t size_{0};
+  Header* hdr_{nullptr};
+  uint64_t mask_{0};
+  MqConfig cfg_{};
+};
+
+} // namespace tr
@@ -0,0 +1,103 @@
+#pragma once
+#include "common.hpp"
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Inline capacity of tr::Task in bytes; override with
+// -DTR_TASK_INLINE_BYTES=N (CMake cache variable of the same name).
+#ifndef TR_TASK_INLINE_BYTES
+#define TR_TASK_INLINE_BYTES 64
+#endif
+
+namespace tr {
+
+// Move-only void() callable with small-buffer storage. Callables that fit
+// (size, alignment, nothrow move) live inline and cost no allocation; larger
+// ones fall back to the heap. Hot paths should assert fits_inline<F> so a
+// capture that grows past the buffer is a compile error, not a silent malloc.
+template <size_t Cap>
+class InlineTask {
+  static_assert(Cap >= sizeof(void*), "inline capacity must hold the heap fallback pointer");
+
+public:
+  static constexpr size_t inline_capacity = Cap;
+
+  template <class F>
+  static constexpr bool fits_inline = sizeof(F) <= Cap &&
+                                      alignof(F) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible<F>::value;
+
+  InlineTask() noexcept = default;
+
+  template <class F, class D = std::decay_t<F>,
+            class = std::enable_if_t<!std::is_same<D, InlineTask>::value>>
+  InlineTask(F&& f) { // NOLINT: implicit like std::function
+    if constexpr (fits_inline<D>) {
+      new (buf_) D(std::forward<F>(f));
+      ops_ = &inline_ops<D>;
+    } else {
+      *reinterpret_cast<D**>(buf_) = new D(std::forward<F>(f));
+      ops_ = &heap_ops<D>;
+    }
+  }
+
+  InlineTask(InlineTask&& o) noexcept { take(o); }
+
+  InlineTask& operator=(InlineTask&& o) noexcept {
+    if (this != &o) { reset(); take(o); }
+    return *this;
+  }
+
+  InlineTask(const InlineTask&) = delete;
+  InlineTask& operator=(const InlineTask&) = delete;
+
+  ~InlineTask() { reset(); }
+
+  void operator()() { ops_->call(buf_); }
+  explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+  void reset() noexcept {
+    if (ops_) { ops_->destroy(buf_); ops_ = nullptr; }
+  }
+
+private:
+  struct Ops {
+    void (*call)(void*);
+    void (*move)(void* dst, void* src) noexcept; // move-construct dst, destroy src
+    void (*destroy)(void*) noexcept;
+  };
+
+  template <class D>
+  static constexpr Ops inline_ops{
+      [](void* p) { (*static_cast<D*>(p))(); },
+      [](void* dst, void* src) noexcept {
+        new (dst) D(std::move(*static_cast<D*>(src)));
+        static_cast<D*>(src)->~D();
+      },
+      [](void* p) noexcept { static_cast<D*>(p)->~D(); },
+  };
+
+  template <class D>
+  static constexpr Ops heap_ops{
+      [](void* p) { (**static_cast<D**>(p))(); },
+      [](void* dst, void* src) noexcept { *static_cast<D**>(dst) = *static_cast<D**>(src); },
+      [](void* p) noexcept { delete *static_cast<D**>(p); },
+  };
+
+  void take(InlineTask& o) noexcept {
+    if (o.ops_) {
+      o.ops_->move(buf_, o.buf_);
+      ops_ = o.ops_;
+      o.ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char buf_[Cap];
+  const Ops* ops_{nullptr};
+};
+
+using Task = InlineTask<TR_TASK_INLINE_BYTES>;
+
+} // namespace tr
@@ -1,62 +1,257 @@
 #pragma once
 #include "common.hpp"
+#include "mpmc_ring.hpp"
+#include "task.hpp"
 #include <condition_variable>
-#include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
 
 namespace tr {
 
+// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). The owning worker pushes and pops
+// at the bottom; any other thread may steal from the top. Grows on demand;
+// retired arrays are kept until the deque dies since a thief may still be
+// reading one.
+template <class T>
+class WorkDeque {
+  static_assert(std::is_pointer<T>::value, "WorkDeque holds pointers");
+
+public:
+  explicit WorkDeque(int64_t capacity = 1024) {
+    int64_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+    arrays_.push_back(std::make_unique<Array>(cap));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  // Owner only.
+  void push(T v) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - t > a->mask) a = grow(a, t, b);
+    a->put(b, v);
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // Owner only. nullptr when empty.
+  T pop() {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T v = a->get(b);
+    if (t == b) {
+      // Last element: race thieves for it.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) v = nullptr;
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return v;
+  }
+
+  // Any thread. nullptr when empty or when another thread won the race.
+  T steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+    Array* a = array_.load(std::memory_order_acquire);
+    T v = a->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return v;
+  }
+
+  bool empty() const {
+    return top_.load(std::memory_order_acquire) >= bottom_.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Array {
+    explicit Array(int64_t cap) : mask(cap - 1), buf(new std::atomic<T>[static_cast<size_t>(cap)]) {}
+    T get(int64_t i) const { return buf[static_cast<size_t>(i & mask)].load(std::memory_order_relaxed); }
+    void put(int64_t i, T v) { buf[static_cast<size_t>(i & mask)].store(v, std::memory_order_relaxed); }
+    int64_t mask;
+    std::unique_ptr<std::atomic<T>[]> buf;
+  };
+
+  Array* grow(Array* a, int64_t t, int64_t b) {
+    arrays_.push_back(std::make_unique<Array>((a->mask + 1) * 2));
+    Array* n = arrays_.back().get();
+    for (int64_t i = t; i < b; ++i) n->put(i, a->get(i));
+    array_.store(n, std::memory_order_release);
+    return n;
+  }
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Array*> array_{nullptr};
+  std::vector<std::unique_ptr<Array>> arrays_; // owner only
+};
+
+// Work-stealing pool. Each worker owns a Chase-Lev deque; tasks submitted
+// from a worker go to its own deque, tasks from any other thread (reactors,
+// the response dispatcher) go through a lock-free injection ring. An idle
+// worker steals from random peers, spins briefly, then parks; submit only
+// takes the park lock when some worker is actually asleep.
+//
+// Tasks are tr::Task (small-buffer, move-only). External submits move the
+// task straight into an injection cell; worker-local submits wrap it in a
+// Job node recycled through a per-worker cache. Neither path allocates in
+// steady state as long as the callable fits Task's inline buffer.
 class ThreadPool {
 public:
-  explicit ThreadPool(size_t n) : stop_(false) {
+  explicit ThreadPool(size_t n, size_t inject_capacity = 16384)
+      : inject_(inject_capacity) {
     if (n == 0) n = 1;
     workers_.reserve(n);
+    for (size_t i = 0; i < n; ++i) workers_.push_back(std::make_unique<Worker>());
     for (size_t i = 0; i < n; ++i) {
-      workers_.emplace_back([this] { worker_loop(); });
+      workers_[i]->th = std::thread([this, i] { worker_loop(i); });
     }
   }
 
   ~ThreadPool() {
     {
-      std::lock_guard<std::mutex> lk(mu_);
-      stop_ = true;
+      std::lock_guard<std::mutex> lk(park_mu_);
+      stop_.store(true, std::memory_order_release);
+      ++park_epoch_;
     }
-    cv_.notify_all();
-    for (auto& t : workers_) t.join();
+    park_cv_.notify_all();
+    for (auto& w : workers_) w->th.join();
   }
 
-  void submit(std::function<void()> fn) {
-    {
-      std::lock_guard<std::mutex> lk(mu_);
-      if (stop_) throw std::runtime_error("ThreadPool stopped");
-      q_.push(std::move(fn));
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(Task fn) {
+    if (stop_.load(std::memory_order_relaxed)) throw std::runtime_error("ThreadPool stopped");
+    if (tl_pool_ == this) {
+      Worker& w = *workers_[tl_index_];
+      Job* job;
+      if (!w.cache.empty()) { job = w.cache.back(); w.cache.pop_back(); }
+      else job = new Job;
+      job->fn = std::move(fn);
+      w.deque.push(job);
+    } else {
+      // A full ring is backpressure: wait for workers to drain it.
+      while (!inject_.try_push(std::move(fn))) std::this_thread::yield();
     }
-    cv_.notify_one();
+    wake_one();
   }
 
+  size_t size() const { return workers_.size(); }
+
 private:
-  void worker_loop() {
+  static constexpr int SPIN_ROUNDS = 64;
+  static constexpr size_t JOB_CACHE = 1024;
+
+  struct Job {
+    Task fn;
+  };
+
+  struct Worker {
+    WorkDeque<Job*> deque;
+    std::vector<Job*> cache; // owner only: recycled Job nodes
+    std::thread th;
+    ~Worker() { for (Job* j : cache) delete j; }
+  };
+
+  void wake_one() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) == 0) return;
+    {
+      std::lock_guard<std::mutex> lk(park_mu_);
+      ++park_epoch_;
+    }
+    park_cv_.notify_one();
+  }
+
+  // Move the next task into out: own deque, injection ring, then peers.
+  bool find_work(size_t self, uint64_t& rng, Task& out) {
+    Worker& w = *workers_[self];
+    Job* j = w.deque.pop();
+    if (!j) {
+      if (inject_.try_pop(out)) return true;
+      const size_t n = workers_.size();
+      if (n > 1) {
+        // xorshift victim order: spreads thieves instead of all hitting worker 0
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        const size_t start = static_cast<size_t>(rng % n);
+        for (size_t k = 0; k < n && !j; ++k) {
+          const size_t v = (start + k) % n;
+          if (v != self) j = workers_[v]->deque.steal();
+        }
+      }
+      if (!j) return false;
+    }
+    out = std::move(j->fn);
+    if (w.cache.size() < JOB_CACHE) w.cache.push_back(j);
+    else delete j;
+    return true;
+  }
+
+  bool any_work() const {
+    if (!inject_.empty()) return true;
+    for (const auto& w : workers_) if (!w->deque.empty()) return true;
+    return false;
+  }
+
+  void run(Task& job) {
+    try { job(); }
+    catch (const std::exception& e) { log_err(std::string("worker exception: ") + e.what()); }
+    catch (...) { log_err("worker unknown exception"); }
+    job.reset();
+  }
+
+  void worker_loop(size_t self) {
+    tl_pool_ = this;
+    tl_index_ = self;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (self + 1);
+    Task job;
     for (;;) {
-      std::function<void()> job;
+      bool got = false;
+      for (int spin = 0; spin < SPIN_ROUNDS && !got; ++spin) {
+        got = find_work(self, rng, job);
+        if (!got) std::this_thread::yield();
+      }
+      if (got) { run(job); continue; }
+
+      // Park: announce, re-check, then sleep until a submit bumps the epoch.
+      uint64_t epoch;
+      {
+        std::lock_guard<std::mutex> lk(park_mu_);
+        epoch = park_epoch_;
+      }
+      sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      if (any_work()) { sleepers_.fetch_sub(1, std::memory_order_relaxed); continue; }
+      if (stop_.load(std::memory_order_acquire)) { sleepers_.fetch_sub(1, std::memory_order_relaxed); return; }
       {
-        std::unique_lock<std::mutex> lk(mu_);
-        cv_.wait(lk, [&]{ return stop_ || !q_.empty(); });
-        if (stop_ && q_.empty()) return;
-        job = std::move(q_.front());
-        q_.pop();
+        std::unique_lock<std::mutex> lk(park_mu_);
+        park_cv_.wait(lk, [&] { return park_epoch_ != epoch; });
       }
-      try { job(); }
-      catch (const std::exception& e) { log_err(std::string("worker exception: ") + e.what()); }
-      catch (...) { log_err("worker unknown exception"); }
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
     }
   }
 
-  std::mutex mu_;
-  std::condition_variable cv_;
-  std::queue<std::function<void()>> q_;
-  std::vector<std::thread> workers_;
-  bool stop_;
+  static thread_local ThreadPool* tl_pool_;
+  static thread_local size_t tl_index_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  MpmcRing<Task> inject_;
+  std::atomic<bool> stop_{false};
+  alignas(64) std::atomic<uint32_t> sleepers_{0};
+  std::mutex park_mu_;
+  std::condition_variable park_cv_;
+  uint64_t park_epoch_{0}; // under park_mu_
 };
 
+inline thread_local ThreadPool* ThreadPool::tl_pool_ = nullptr;
+inline thread_local size_t ThreadPool::tl_index_ = 0;
+
 } // namespace tr
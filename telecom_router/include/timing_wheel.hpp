@@ -0,0 +1,160 @@
+#pragma once
+#include "common.hpp"
+#include <type_traits>
+
+namespace tr {
+
+// Hierarchical hashed timing wheel (4 levels x 256 slots, Linux-style
+// cascading). Single-threaded: owned and driven by one reactor.
+//
+// Timers live in an index-linked node pool, so schedule and cancel are O(1)
+// with no allocation in steady state. A TimerId carries the node's
+// generation; cancelling a timer that already fired (or was cancelled) is a
+// harmless no-op even after the node has been reused.
+template <class T>
+class TimingWheel {
+  static_assert(std::is_trivially_copyable<T>::value, "timer payloads are copied");
+
+public:
+  using TimerId = uint64_t;
+  static constexpr TimerId INVALID = ~TimerId{0};
+
+  TimingWheel(uint64_t tick_ms, uint64_t now_ms)
+      : tick_ms_(tick_ms == 0 ? 1 : tick_ms), now_tick_(now_ms / tick_ms_) {
+    for (auto& h : heads_) h = NIL;
+  }
+
+  TimerId schedule(uint64_t deadline_ms, const T& payload) {
+    uint32_t idx;
+    if (free_ != NIL) {
+      idx = free_;
+      free_ = nodes_[idx].next;
+    } else {
+      idx = static_cast<uint32_t>(nodes_.size());
+      nodes_.emplace_back();
+    }
+    Node& n = nodes_[idx];
+    n.payload = payload;
+    n.expires = std::max((deadline_ms + tick_ms_ - 1) / tick_ms_, now_tick_ + 1);
+    n.live = true;
+    link(idx);
+    ++count_;
+    return (static_cast<uint64_t>(n.gen) << 32) | idx;
+  }
+
+  bool cancel(TimerId id) {
+    const uint32_t idx = static_cast<uint32_t>(id);
+    if (id == INVALID || idx >= nodes_.size()) return false;
+    Node& n = nodes_[idx];
+    if (!n.live || n.gen != static_cast<uint32_t>(id >> 32)) return false;
+    unlink(idx);
+    release(idx);
+    return true;
+  }
+
+  // Replace the payload of a pending timer (e.g. once its key is known).
+  bool update(TimerId id, const T& payload) {
+    const uint32_t idx = static_cast<uint32_t>(id);
+    if (id == INVALID || idx >= nodes_.size()) return false;
+    Node& n = nodes_[idx];
+    if (!n.live || n.gen != static_cast<uint32_t>(id >> 32)) return false;
+    n.payload = payload;
+    return true;
+  }
+
+  // Fire every timer due at or before now_ms: on_expire(const T&). Callbacks
+  // may schedule or cancel timers.
+  template <class F>
+  void advance(uint64_t now_ms, F&& on_expire) {
+    const uint64_t target = now_ms / tick_ms_;
+    if (count_ == 0) { now_tick_ = std::max(now_tick_, target); return; }
+    while (now_tick_ < target) {
+      ++now_tick_;
+      // Cascade higher levels first so their timers land in level 0 in time.
+      for (unsigned lvl = LEVELS - 1; lvl >= 1; --lvl) {
+        if ((now_tick_ & ((uint64_t{1} << (BITS * lvl)) - 1)) == 0) cascade(lvl);
+      }
+      // Pop one at a time: a callback may cancel a sibling in this slot.
+      const unsigned slot = static_cast<unsigned>(now_tick_ & MASK);
+      uint32_t idx;
+      while ((idx = heads_[slot]) != NIL) {
+        unlink(idx);
+        const T payload = nodes_[idx].payload;
+        release(idx);
+        on_expire(payload);
+      }
+      if (count_ == 0) { now_tick_ = target; break; }
+    }
+  }
+
+  size_t size() const { return count_; }
+  uint64_t tick_ms() const { return tick_ms_; }
+
+private:
+  static constexpr unsigned BITS = 8;
+  static constexpr unsigned SLOTS = 1u << BITS;
+  static constexpr uint64_t MASK = SLOTS - 1;
+  static constexpr unsigned LEVELS = 4;
+  static constexpr uint32_t NIL = 0xFFFFFFFFu;
+
+  struct Node {
+    uint32_t prev{NIL};
+    uint32_t next{NIL};
+    uint32_t gen{0};
+    uint32_t slot{0}; // index into heads_
+    uint64_t expires{0};
+    bool live{false};
+    T payload{};
+  };
+
+  void link(uint32_t idx) {
+    Node& n = nodes_[idx];
+    uint64_t delta = n.expires - now_tick_;
+    unsigned lvl = 0;
+    while (lvl + 1 < LEVELS && delta >= (uint64_t{1} << (BITS * (lvl + 1)))) ++lvl;
+    if (lvl == LEVELS - 1 && delta >= (uint64_t{1} << (BITS * LEVELS))) {
+      n.expires = now_tick_ + (uint64_t{1} << (BITS * LEVELS)) - 1; // clamp to wheel span
+    }
+    n.slot = lvl * SLOTS + static_cast<uint32_t>((n.expires >> (BITS * lvl)) & MASK);
+    n.prev = NIL;
+    n.next = heads_[n.slot];
+    if (n.next != NIL) nodes_[n.next].prev = idx;
+    heads_[n.slot] = idx;
+  }
+
+  void unlink(uint32_t idx) {
+    Node& n = nodes_[idx];
+    if (n.prev != NIL) nodes_[n.prev].next = n.next;
+    else heads_[n.slot] = n.next;
+    if (n.next != NIL) nodes_[n.next].prev = n.prev;
+  }
+
+  void release(uint32_t idx) {
+    Node& n = nodes_[idx];
+    n.live = false;
+    ++n.gen;
+    n.next = free_;
+    free_ = idx;
+    --count_;
+  }
+
+  void cascade(unsigned lvl) {
+    const uint32_t slot = lvl * SLOTS + static_cast<uint32_t>((now_tick_ >> (BITS * lvl)) & MASK);
+    uint32_t idx = heads_[slot];
+    heads_[slot] = NIL;
+    while (idx != NIL) {
+      const uint32_t next = nodes_[idx].next;
+      link(idx);
+      idx = next;
+    }
+  }
+
+  uint64_t tick_ms_;
+  uint64_t now_tick_;
+  uint32_t heads_[LEVELS * SLOTS];
+  std::vector<Node> nodes_;
+  uint32_t free_{NIL};
+  size_t count_{0};
+};
+
+} // namespace tr
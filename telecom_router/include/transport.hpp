@@ -0,0 +1,111 @@
+#pragma once
+#include "common.hpp"
+#include "ipc_mq.hpp"
+#include "shm_ring.hpp"
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace tr {
+
+// Server <-> engine message transport, chosen per deployment. Both ends must
+// agree (--transport=mq|shm on routing_server and flx_engine).
+enum class Transport { Mq, Shm };
+
+inline std::optional<Transport> parse_transport(const std::string& s) {
+  if (s == "mq") return Transport::Mq;
+  if (s == "shm") return Transport::Shm;
+  return std::nullopt;
+}
+
+inline const char* transport_name(Transport t) { return t == Transport::Shm ? "shm" : "mq"; }
+
+// Well-known queue names for each transport ("req" / "resp"). Engine shard 0
+// keeps the unsuffixed names; shard k appends "_k".
+inline std::string channel_name(Transport t, const std::string& dir, uint32_t shard = 0) {
+  std::string name = (t == Transport::Shm ? "/tr_shm_" : "/tr_mq_") + dir;
+  if (shard) name += "_" + std::to_string(shard);
+  return name;
+}
+
+// One direction of the server <-> engine link over either transport.
+class MsgChannel {
+public:
+  MsgChannel() = default;
+  ~MsgChannel() {
+    if (ep_ >= 0) ::close(ep_);
+  }
+
+  MsgChannel(const MsgChannel&) = delete;
+  MsgChannel& operator=(const MsgChannel&) = delete;
+
+  void open(Transport t, const MqConfig& cfg) {
+    kind_ = t;
+    if (t == Transport::Shm) shm_.open(cfg);
+    else mq_.open(cfg);
+  }
+
+  void unlink_queue() {
+    if (kind_ == Transport::Shm) shm_.unlink_queue();
+    else mq_.unlink_queue();
+  }
+
+  bool send(const uint8_t* data, size_t len, unsigned prio = 0) {
+    return kind_ == Transport::Shm ? shm_.send(data, len, prio) : mq_.send(data, len, prio);
+  }
+
+  ssize_t recv(uint8_t* buf, size_t cap, unsigned* prio = nullptr) {
+    return kind_ == Transport::Shm ? shm_.recv(buf, cap, prio) : mq_.recv(buf, cap, prio);
+  }
+
+  // Receive one message and call f(const uint8_t*, size_t) on its bytes.
+  // Over shm the bytes are read in place from the shared cell (no copy);
+  // over MQ they land in a reused scratch buffer. False if nothing arrived.
+  template <class F>
+  bool recv_with(F&& f) {
+    if (kind_ == Transport::Shm) {
+      ShmQueue::View v;
+      if (!shm_.wait_peek(v)) return false;
+      try { f(v.data, v.len); } catch (...) { shm_.release(v); throw; }
+      shm_.release(v);
+      return true;
+    }
+    scratch_.resize(static_cast<size_t>(mq_.msgsize()));
+    const ssize_t n = mq_.recv(scratch_.data(), scratch_.size(), nullptr);
+    if (n < 0) return false;
+    f(static_cast<const uint8_t*>(scratch_.data()), static_cast<size_t>(n));
+    return true;
+  }
+
+  // Block until a message is probably waiting or timeout_ms passes; false on
+  // timeout. Pair with a channel opened nonblock and drain it with
+  // recv_with() until that returns false. Over MQ the descriptor sits in this
+  // channel's own epoll set with EPOLLEXCLUSIVE, so when several channels on
+  // one queue wait (one per worker) a message wakes one of them, not all;
+  // over shm the wait is the ring's futex.
+  bool wait_readable(int timeout_ms) {
+    if (kind_ == Transport::Shm) return shm_.wait_nonempty(timeout_ms);
+    if (ep_ < 0) {
+      ep_ = epoll_create1(EPOLL_CLOEXEC);
+      if (ep_ < 0) throw std::runtime_error("epoll_create1 failed: " + std::string(std::strerror(errno)));
+      epoll_event ev{};
+      ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+      if (epoll_ctl(ep_, EPOLL_CTL_ADD, mq_.fd(), &ev) != 0) {
+        throw std::runtime_error("epoll_ctl(mq) failed: " + std::string(std::strerror(errno)));
+      }
+    }
+    epoll_event ev{};
+    return epoll_wait(ep_, &ev, 1, timeout_ms) > 0;
+  }
+
+  Transport kind() const { return kind_; }
+  long msgsize() const { return kind_ == Transport::Shm ? shm_.msgsize() : mq_.msgsize(); }
+
+private:
+  Transport kind_{Transport::Mq};
+  PosixMq mq_;
+  ShmQueue shm_;
+  std::vector<uint8_t> scratch_;
+  int ep_{-1}; // MQ: epoll set for wait_readable(), created on first use
+};
+
+} // namespace tr
@@ -0,0 +1,232 @@
+#pragma once
+#include "common.hpp"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace tr {
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing dependency).
+// One ring per reactor thread; the owning thread is the only submitter.
+class Uring {
+public:
+  Uring() = default;
+  ~Uring() { close(); }
+
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+
+  // Throws if the kernel does not provide io_uring (ENOSYS, seccomp EPERM, ...)
+  // or lacks the features the reactor relies on.
+  void init(unsigned entries) {
+    close();
+    io_uring_params p{};
+    p.flags = IORING_SETUP_SUBMIT_ALL;
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0) {
+      throw std::runtime_error("io_uring_setup failed: " + std::string(std::strerror(errno)));
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+      close();
+      throw std::runtime_error("io_uring kernel too old (need SINGLE_MMAP + EXT_ARG)");
+    }
+    if (!multishot_supported()) {
+      close();
+      throw std::runtime_error("io_uring kernel too old (need multishot accept + recv, Linux 6.0)");
+    }
+
+    ring_sz_ = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                        p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    ring_ = mmap(nullptr, ring_sz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 fd_, IORING_OFF_SQ_RING);
+    if (ring_ == MAP_FAILED) { ring_ = nullptr; close(); throw std::runtime_error("io_uring ring mmap failed"); }
+
+    sqes_sz_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sq = mmap(nullptr, sqes_sz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_SQES);
+    if (sq == MAP_FAILED) { close(); throw std::runtime_error("io_uring sqe mmap failed"); }
+    sqes_ = static_cast<io_uring_sqe*>(sq);
+
+    auto* base = static_cast<uint8_t*>(ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+    cq_head_ = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+
+    // Identity SQ index array: slot i always refers to sqes_[i].
+    auto* array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) array[i] = i;
+    local_tail_ = *sq_tail_;
+  }
+
+  void close() {
+    if (sqes_) { munmap(sqes_, sqes_sz_); sqes_ = nullptr; }
+    if (ring_) { munmap(ring_, ring_sz_); ring_ = nullptr; }
+    if (fd_ >= 0) { ::close(fd_); fd_ = -1; }
+  }
+
+  int fd() const { return fd_; }
+
+  // Returns a zeroed SQE; flushes queued SQEs to the kernel if the SQ is full.
+  io_uring_sqe* get_sqe() {
+    if (local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      enter(0, 0);
+    }
+    io_uring_sqe* sqe = &sqes_[local_tail_ & sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++local_tail_;
+    return sqe;
+  }
+
+  // Submit everything queued since the last call and wait for at least
+  // wait_nr completions or timeout_ms, whichever comes first. One syscall.
+  void submit_and_wait(unsigned wait_nr, int timeout_ms) {
+    __kernel_timespec ts{};
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000LL;
+    io_uring_getevents_arg arg{};
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    enter(wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  }
+
+  // Invoke f(const io_uring_cqe&) for every available completion.
+  template <class F>
+  unsigned drain(F&& f) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned n = 0;
+    for (; head != tail; ++head, ++n) {
+      const io_uring_cqe cqe = cqes_[head & cq_mask_];
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      f(cqe);
+    }
+    return n;
+  }
+
+  int register_op(unsigned opcode, void* arg, unsigned nr) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd_, opcode, arg, nr));
+  }
+
+private:
+  // The probe lists opcodes, not flags: multishot accept arrived in 5.19
+  // together with IORING_OP_SOCKET, multishot recv in 6.0 together with
+  // IORING_OP_SEND_ZC. Without them a multishot SQE fails with -EINVAL.
+  bool multishot_supported() {
+    constexpr unsigned N = 256;
+    alignas(io_uring_probe) uint8_t buf[sizeof(io_uring_probe) + N * sizeof(io_uring_probe_op)]{};
+    auto* probe = reinterpret_cast<io_uring_probe*>(buf);
+    if (register_op(IORING_REGISTER_PROBE, probe, N) < 0) return false;
+    for (unsigned op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ,
+                        IORING_OP_PROVIDE_BUFFERS, IORING_OP_SOCKET, IORING_OP_SEND_ZC}) {
+      if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+  }
+
+  void enter(unsigned wait_nr, unsigned flags, void* arg = nullptr, size_t argsz = 0) {
+    const unsigned to_submit = local_tail_ - *sq_tail_;
+    __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+    for (;;) {
+      long r = syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr, flags, arg, argsz);
+      if (r >= 0) return;
+      if (errno == EINTR) continue;
+      if (errno == ETIME || errno == EAGAIN || errno == EBUSY) return;
+      throw std::runtime_error("io_uring_enter failed: " + std::string(std::strerror(errno)));
+    }
+  }
+
+  int fd_{-1};
+  void* ring_{nullptr};
+  size_t ring_sz_{0};
+  io_uring_sqe* sqes_{nullptr};
+  size_t sqes_sz_{0};
+
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned sq_entries_{0};
+  unsigned local_tail_{0};
+
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe* cqes_{nullptr};
+};
+
+// Provided-buffer group for multishot recv: the kernel picks a buffer for
+// each completion, the reactor hands it back after framing. Buffers are
+// (re)provided with IORING_OP_PROVIDE_BUFFERS SQEs, which ride along with the
+// next submit instead of costing a syscall each.
+class UringBufPool {
+public:
+  UringBufPool() = default;
+  ~UringBufPool() { release(); }
+
+  UringBufPool(const UringBufPool&) = delete;
+  UringBufPool& operator=(const UringBufPool&) = delete;
+
+  void init(Uring& ring, uint16_t bgid, unsigned entries, unsigned buf_size) {
+    if (entries == 0 || entries > 65536) throw std::runtime_error("bad buffer pool size");
+    release();
+    ring_ = &ring;
+    bgid_ = bgid;
+    buf_size_ = buf_size;
+
+    data_sz_ = static_cast<size_t>(entries) * buf_size;
+    void* d = mmap(nullptr, data_sz_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (d == MAP_FAILED) throw std::runtime_error("buffer pool mmap failed");
+    data_ = static_cast<uint8_t*>(d);
+
+    io_uring_sqe* sqe = ring.get_sqe();
+    provide(sqe, 0, entries);
+    sqe->flags = 0; // want the completion: it tells us the kernel accepted them
+    sqe->user_data = 0;
+    ring.submit_and_wait(1, 1000);
+    int res = -ETIME;
+    ring.drain([&](const io_uring_cqe& cqe) { if (cqe.user_data == 0) res = cqe.res; });
+    if (res < 0) {
+      release();
+      throw std::runtime_error("IORING_OP_PROVIDE_BUFFERS failed: " + std::string(std::strerror(-res)));
+    }
+  }
+
+  uint16_t group() const { return bgid_; }
+  unsigned buf_size() const { return buf_size_; }
+  const char* buf(uint16_t bid) const {
+    return reinterpret_cast<const char*>(data_ + static_cast<size_t>(bid) * buf_size_);
+  }
+
+  // Return a consumed buffer to the kernel (queued, submitted with the next wait).
+  void recycle(uint16_t bid) { provide(ring_->get_sqe(), bid, 1); }
+
+private:
+  void provide(io_uring_sqe* sqe, uint16_t first_bid, unsigned n) {
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(n);
+    sqe->addr = reinterpret_cast<uint64_t>(data_ + static_cast<size_t>(first_bid) * buf_size_);
+    sqe->len = buf_size_;
+    sqe->off = first_bid;
+    sqe->buf_group = bgid_;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = 0;
+  }
+  void release() {
+    if (data_) { munmap(data_, data_sz_); data_ = nullptr; }
+  }
+
+  Uring* ring_{nullptr};
+  uint8_t* data_{nullptr};
+  size_t data_sz_{0};
+  unsigned buf_size_{0};
+  uint16_t bgid_{0};
+};
+
+} // namespace tr
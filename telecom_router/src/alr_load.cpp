@@ -0,0 +1,66 @@
+// Bulk-load an ALR provisioning dump and optionally write it out as a
+// snapshot for flx_engine --alr-snapshot.
+//
+//   alr_load <dump.csv|dump.tsv> [--threads=N] [--snapshot=PATH]
+//
+// Rows are msisdn, imsi, msc, vlr, region (see load_alr_dump). Threads
+// default to the number of online CPUs.
+#include "alr_store.hpp"
+
+#include <cstdio>
+
+using namespace tr;
+
+static double secs_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+  std::string dump, snapshot;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    bool ok = true;
+    if (a.rfind("--threads=", 0) == 0 && a.size() > 10) {
+      char* end = nullptr;
+      threads = static_cast<size_t>(std::strtoull(a.c_str() + 10, &end, 10));
+      ok = *end == '\0' && threads > 0 && threads <= 1024;
+    } else if (a.rfind("--snapshot=", 0) == 0 && a.size() > 11) {
+      snapshot = a.substr(11);
+    } else if (dump.empty() && a.rfind("--", 0) != 0) {
+      dump = a;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      dump.clear();
+      break;
+    }
+  }
+  if (dump.empty()) {
+    log_err("usage: alr_load <dump.csv|dump.tsv> [--threads=N] [--snapshot=PATH]");
+    return 2;
+  }
+
+  try {
+    AlrStore alr;
+    const auto t0 = std::chrono::steady_clock::now();
+    const AlrLoadStats st = alr.bulk_load(dump, threads);
+    const double load_s = secs_since(t0);
+    char line[256];
+    std::snprintf(line, sizeof(line), "loaded %zu subscribers from %zu rows (%zu rejected) in %.2f s, %.1f M rows/s, %zu threads",
+                  st.loaded, st.rows, st.rejected, load_s, static_cast<double>(st.rows) / load_s / 1e6, threads);
+    log_info(line);
+
+    if (!snapshot.empty()) {
+      const auto t1 = std::chrono::steady_clock::now();
+      alr.write_snapshot(snapshot);
+      std::snprintf(line, sizeof(line), "snapshot %s written in %.2f s", snapshot.c_str(), secs_since(t1));
+      log_info(line);
+    }
+  } catch (const std::exception& e) {
+    log_err(e.what());
+    return 1;
+  }
+  return 0;
+}
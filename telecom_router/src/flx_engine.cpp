@@ -1,105 +1,315 @@
 #include "alr_store.hpp"
-#include "ipc_mq.hpp"
 #include "protocol.hpp"
+#include "transport.hpp"
 
 #include <atomic>
+#include <charconv>
 #include <csignal>
+#include <memory>
 
 using namespace tr;
 
 static std::atomic<bool> g_run{true};
 static void on_sig(int) { g_run = false; }
 
-static std::string json_get_string(const std::string& j, const std::string& key) {
+static std::string_view json_get_string(std::string_view j, std::string_view key) {
   // Minimal JSON extraction for demo (production: use a JSON lib like RapidJSON)
-  // expects: "key":"value"
-  const std::string pat = "\"" + key + "\"";
-  auto k = j.find(pat);
-  if (k == std::string::npos) return {};
-  auto colon = j.find(':', k + pat.size());
-  if (colon == std::string::npos) return {};
+  // expects: "key":"value"; the value is returned raw, in place
+  size_t k = 0;
+  for (;; ++k) {
+    k = j.find(key, k);
+    if (k == std::string_view::npos) return {};
+    if (k > 0 && j[k - 1] == '"' && k + key.size() < j.size() && j[k + key.size()] == '"') break;
+  }
+  auto colon = j.find(':', k + key.size() + 1);
+  if (colon == std::string_view::npos) return {};
   auto q1 = j.find('"', colon);
-  if (q1 == std::string::npos) return {};
+  if (q1 == std::string_view::npos) return {};
   auto q2 = j.find('"', q1 + 1);
-  if (q2 == std::string::npos) return {};
+  if (q2 == std::string_view::npos) return {};
   return j.substr(q1 + 1, q2 - (q1 + 1));
 }
 
-int main() {
-  std::signal(SIGINT, on_sig);
-  std::signal(SIGTERM, on_sig);
+static void append_uint(std::string& out, uint64_t v) {
+  char buf[24];
+  const auto r = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, static_cast<size_t>(r.ptr - buf));
+}
 
-  const std::string REQ  = "/tr_mq_req";
-  const std::string RESP = "/tr_mq_resp";
+static void send_resp(MsgChannel& mq_resp, std::string_view out) {
+  try {
+    (void)mq_resp.send(reinterpret_cast<const uint8_t*>(out.data()), out.size(), 0);
+  } catch (const std::exception& e) {
+    log_err(std::string("mq send error: ") + e.what());
+  }
+}
 
-  // Engine creates queues (server opens without create)
-  PosixMq mq_req, mq_resp;
-  mq_req.open(MqConfig{REQ, 2048, 8192, true, false});
-  mq_resp.open(MqConfig{RESP, 2048, 8192, true, false});
+// Collects a worker's answers into response batches, sending a batch when the
+// next answer would not fit and whatever is left at flush(). The batch and
+// JSON scratch buffers are reused, so answering allocates nothing.
+struct Responder {
+  MsgChannel& resp;
+  BatchBuilder batch;
+  std::string json;
 
-  log_info("FLX engine started. MQ REQ=" + REQ + " RESP=" + RESP);
+  explicit Responder(MsgChannel& ch) : resp(ch), batch(static_cast<size_t>(ch.msgsize())) {}
 
-  AlrStore alr;
-  std::vector<uint8_t> buf(static_cast<size_t>(mq_req.msgsize()));
+  void emit(MsgType t, uint64_t corr_id, std::string_view payload) {
+    if (!batch.fits(sizeof(MsgHdr) + payload.size())) flush();
+    batch.add(t, corr_id, payload);
+  }
 
-  while (g_run.load()) {
-    ssize_t n = -1;
-    try {
-      n = mq_req.recv(buf.data(), buf.size(), nullptr); // blocking
-    } catch (const std::exception& e) {
-      log_err(std::string("mq recv error: ") + e.what());
-      continue;
-    }
-    if (n <= 0) continue;
+  void flush() {
+    if (batch.empty()) return;
+    send_resp(resp, batch.seal());
+    batch.clear();
+  }
+};
+
+// Apply a location update. nullopt, with why set, if it was not applied:
+// unknown subscriber (NotInAlr), a missing or over-long name (BadRequest),
+// or a name that was never provisioned (UnknownName). Names are only looked
+// up, never added: clients cannot grow the pools, and no lock is taken.
+static std::optional<AlrEntry> update_location(AlrStore& alr, std::string_view msisdn, std::string_view msc,
+                                               std::string_view vlr, std::string_view region, RouteReason& why) {
+  constexpr size_t MAX_NAME = sizeof(BinRouteResp::serving_msc); // what a binary answer can carry
+  if (msc.empty() || vlr.empty() || msc.size() > MAX_NAME || vlr.size() > MAX_NAME || region.size() > MAX_NAME) {
+    why = RouteReason::BadRequest;
+    return std::nullopt;
+  }
+  const auto m = msc_names().find(msc);
+  const auto v = vlr_names().find(vlr);
+  const auto rg = region.empty() ? std::nullopt : region_names().find(region);
+  if (!m || !v || (!region.empty() && !rg)) {
+    why = RouteReason::UnknownName;
+    return std::nullopt;
+  }
+  auto rec = alr.update_location(msisdn, *m, *v, rg);
+  if (!rec) why = RouteReason::NotInAlr;
+  return rec;
+}
+
+static RouteStatus failure_status(RouteReason why) {
+  return why == RouteReason::NotInAlr ? RouteStatus::NotFound : RouteStatus::Error;
+}
+
+// Binary route request or location update: fixed layout in, fixed layout
+// out, no JSON.
+static void answer_bin(AlrStore& alr, MsgType type, uint64_t corr_id, std::string_view payload, Responder& out) {
+  BinUpdateLocReq req; // a BinRouteReq is its prefix
+  std::memcpy(&req, payload.data(), payload.size());
+  const uint64_t t0 = steady_millis();
+
+  BinRouteResp resp{};
+  RouteReason why = RouteReason::NotInAlr;
+  const auto rec = type == MsgType::UpdateLocReqBin
+                       ? update_location(alr, fixed_str(req.msisdn), fixed_str(req.serving_msc),
+                                         fixed_str(req.serving_vlr), fixed_str(req.region), why)
+                       : alr.find(fixed_str(req.msisdn));
+  if (!rec) {
+    resp.status = static_cast<uint16_t>(failure_status(why));
+    resp.reason = static_cast<uint16_t>(why);
+  } else {
+    resp.status = static_cast<uint16_t>(RouteStatus::Ok);
+    char imsi[MAX_PACKED_DIGITS];
+    set_fixed(resp.imsi, std::string_view(imsi, unpack_digits(rec->imsi, imsi)));
+    set_fixed(resp.serving_msc, msc_names().name(rec->msc()));
+    set_fixed(resp.serving_vlr, vlr_names().name(rec->vlr()));
+    set_fixed(resp.route_group, route_group_names().name(route_policy(rec->region())));
+  }
+  resp.flx_latency_ms = static_cast<uint32_t>(steady_millis() - t0);
+  out.emit(MsgType::RouteRespBin, corr_id, std::string_view(reinterpret_cast<const char*>(&resp), sizeof(resp)));
+}
+
+static void answer_json(AlrStore& alr, uint64_t corr_id, std::string_view req, Responder& out) {
+  const auto msisdn = json_get_string(req, "msisdn");
+  const auto op = json_get_string(req, "op");
+
+  // Simulate routing work + low latency decision
+  const uint64_t t0 = steady_millis();
+
+  std::string& resp = out.json;
+  resp.clear();
+  resp += "{\"corr_id\":";
+  append_uint(resp, corr_id);
+  resp += ",\"op\":\"";
+  resp += op.empty() ? std::string_view("route") : op;
+  resp += "\",\"msisdn\":\"";
+  resp += msisdn;
+  resp += "\",";
+
+  RouteReason why = RouteReason::NotInAlr;
+  const auto rec = op == "update_location"
+                       ? update_location(alr, msisdn, json_get_string(req, "serving_msc"),
+                                         json_get_string(req, "serving_vlr"), json_get_string(req, "region"), why)
+                       : alr.find(msisdn);
+  if (!rec) {
+    resp += "\"status\":\"";
+    resp += status_name(failure_status(why));
+    resp += "\",\"reason\":\"";
+    resp += reason_name(why);
+    resp += "\"";
+  } else {
+    char imsi[MAX_PACKED_DIGITS];
+    resp += "\"status\":\"OK\",\"imsi\":\"";
+    resp.append(imsi, unpack_digits(rec->imsi, imsi));
+    resp += "\",\"serving_msc\":\"";
+    resp += msc_names().name(rec->msc());
+    resp += "\",\"serving_vlr\":\"";
+    resp += vlr_names().name(rec->vlr());
+    resp += "\",\"route_group\":\"";
+    resp += route_group_names().name(route_policy(rec->region()));
+    resp += "\"";
+  }
+
+  const uint64_t t1 = steady_millis();
+  resp += ",\"flx_latency_ms\":";
+  append_uint(resp, t1 - t0);
+  resp += "}";
+  out.emit(MsgType::RouteResp, corr_id, resp);
+}
+
+// Answer one request into out.
+static void answer(AlrStore& alr, const MsgHdr& h, std::string_view payload, Responder& out) {
+  const auto type = static_cast<MsgType>(h.type);
+  switch (type) {
+    case MsgType::RouteReq: answer_json(alr, h.corr_id, payload, out); return;
+    case MsgType::RouteReqBin:
+    case MsgType::UpdateLocReqBin:
+      if (payload.size() == (type == MsgType::RouteReqBin ? sizeof(BinRouteReq) : sizeof(BinUpdateLocReq))) {
+        answer_bin(alr, type, h.corr_id, payload, out);
+        return;
+      }
+      break;
+    default: break;
+  }
+  log_warn("unexpected msg type");
+}
+
+constexpr int IDLE_WAIT_MS = 200; // workers re-check g_run this often
 
-    MsgHdr h{};
-    std::string payload;
-    if (!unpack(buf.data(), static_cast<size_t>(n), h, payload)) {
+// One worker's handles on the shard's queues. Each worker opens its own, so
+// nothing (descriptor, scratch buffer, epoll set) is shared between threads.
+struct WorkerChannels {
+  MsgChannel req, resp;
+};
+
+// Worker loop: wait until requests are queued, take up to `drain` messages
+// (a Batch envelope counts once), answer every record, and send the answers
+// together as response Batch envelopes. Messages are decoded in place (over
+// shm, straight out of the shared cell). Workers share the ALR without
+// locking: lookups never wait on location updates (see AlrStore).
+static void run_worker(WorkerChannels& ch, AlrStore& alr, size_t drain) {
+  Responder out(ch.resp);
+  auto reply = [&](const MsgHdr& h, std::string_view payload) { answer(alr, h, payload, out); };
+  auto on_msg = [&](const uint8_t* data, size_t n) {
+    const auto m = unpack_view(data, n);
+    if (!m) {
       log_warn("bad message received");
-      continue;
+      return;
     }
-    if (static_cast<MsgType>(h.type) != MsgType::RouteReq) {
-      log_warn("unexpected msg type");
-      continue;
+    if (static_cast<MsgType>(m->hdr.type) != MsgType::Batch) {
+      reply(m->hdr, m->payload);
+      return;
     }
+    if (!unpack_batch(m->payload, reply)) log_warn("malformed request batch");
+  };
 
-    const auto msisdn = json_get_string(payload, "msisdn");
-    const auto op = json_get_string(payload, "op");
+  while (g_run.load()) {
+    try {
+      if (!ch.req.wait_readable(IDLE_WAIT_MS)) continue;
+      for (size_t n = 0; n < drain && ch.req.recv_with(on_msg); ++n) {
+      }
+    } catch (const std::exception& e) {
+      log_err(std::string("mq recv error: ") + e.what());
+    }
+    out.flush();
+  }
+}
 
-    // Simulate routing work + low latency decision
-    const uint64_t t0 = steady_millis();
+// --name=N with N >= 1
+static bool parse_count(const std::string& a, const char* name, size_t& out) {
+  const size_t len = std::strlen(name);
+  if (a.compare(0, len, name) != 0 || a.size() == len) return false;
+  char* end = nullptr;
+  const unsigned long long v = std::strtoull(a.c_str() + len, &end, 10);
+  if (*end != '\0' || v == 0) return false;
+  out = static_cast<size_t>(v);
+  return true;
+}
 
-    std::ostringstream resp;
-    resp << "{";
-    resp << "\"corr_id\":" << h.corr_id << ",";
-    resp << "\"op\":\"" << (op.empty() ? "route" : op) << "\",";
-    resp << "\"msisdn\":\"" << msisdn << "\",";
+int main(int argc, char** argv) {
+  std::signal(SIGINT, on_sig);
+  std::signal(SIGTERM, on_sig);
 
-    auto rec = alr.lookup_msisdn(msisdn);
-    if (!rec) {
-      resp << "\"status\":\"NOT_FOUND\",";
-      resp << "\"reason\":\"subscriber_not_in_alr\"";
+  Transport transport = Transport::Mq;
+  uint32_t shard = 0;
+  size_t workers = 1;
+  size_t drain = 64;
+  std::string snapshot;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    bool ok = false;
+    if (a.rfind("--transport=", 0) == 0) {
+      const auto t = parse_transport(a.substr(12));
+      if (t) transport = *t;
+      ok = t.has_value();
+    } else if (a.rfind("--shard=", 0) == 0 && a.size() > 8) {
+      char* end = nullptr;
+      shard = static_cast<uint32_t>(std::strtoul(a.c_str() + 8, &end, 10));
+      ok = *end == '\0';
+    } else if (a.rfind("--alr-snapshot=", 0) == 0 && a.size() > 15) {
+      snapshot = a.substr(15);
+      ok = true;
     } else {
-      const auto rg = route_policy(*rec);
-      resp << "\"status\":\"OK\",";
-      resp << "\"imsi\":\"" << rec->imsi << "\",";
-      resp << "\"serving_msc\":\"" << rec->serving_msc << "\",";
-      resp << "\"serving_vlr\":\"" << rec->serving_vlr << "\",";
-      resp << "\"route_group\":\"" << rg << "\"";
+      ok = parse_count(a, "--workers=", workers) || parse_count(a, "--drain=", drain);
     }
+    if (!ok) {
+      log_err("usage: flx_engine [--transport=mq|shm] [--shard=K] [--workers=N] [--drain=K] [--alr-snapshot=PATH]");
+      return 2;
+    }
+  }
 
-    const uint64_t t1 = steady_millis();
-    resp << ",\"flx_latency_ms\":" << (t1 - t0);
-    resp << "}";
-
-    auto out = pack(MsgType::RouteResp, h.corr_id, resp.str());
+  // Mapped, not parsed: ready in O(1) whatever the subscriber count.
+  AlrStore alr;
+  if (!snapshot.empty()) {
     try {
-      (void)mq_resp.send(out.data(), out.size(), 0);
+      alr.load_snapshot(snapshot);
     } catch (const std::exception& e) {
-      log_err(std::string("mq send error: ") + e.what());
+      log_err(e.what());
+      return 1;
     }
   }
 
+  // Shard K serves its own queue pair; the routing server hashes MSISDNs
+  // across the shards it was told about (--shards=N, shard_add).
+  const std::string REQ  = channel_name(transport, "req", shard);
+  const std::string RESP = channel_name(transport, "resp", shard);
+
+  // Engine creates queues (server opens without create); the workers then
+  // open their own non-blocking handles on them.
+  MsgChannel mq_req, mq_resp;
+  mq_req.open(transport, MqConfig{REQ, 2048, 8192, true, false});
+  mq_resp.open(transport, MqConfig{RESP, 2048, 8192, true, false});
+  std::vector<std::unique_ptr<WorkerChannels>> chans;
+  for (size_t i = 0; i < workers; ++i) {
+    auto ch = std::make_unique<WorkerChannels>();
+    ch->req.open(transport, MqConfig{REQ, 2048, 8192, false, true});
+    ch->resp.open(transport, MqConfig{RESP, 2048, 8192, false, false});
+    chans.push_back(std::move(ch));
+  }
+
+  log_info(std::string("FLX engine started. transport=") + transport_name(transport) +
+           " shard=" + std::to_string(shard) + " workers=" + std::to_string(workers) +
+           " drain=" + std::to_string(drain) + " subscribers=" + std::to_string(alr.size()) +
+           (snapshot.empty() ? "" : " snapshot=" + snapshot) + " REQ=" + REQ + " RESP=" + RESP);
+
+  std::vector<std::thread> threads;
+  for (auto& ch : chans) {
+    threads.emplace_back([&alr, drain, c = ch.get()] { run_worker(*c, alr, drain); });
+  }
+  for (auto& t : threads) t.join();
+
   log_info("FLX engine stopping.");
   return 0;
 }
@@ -1,41 +1,221 @@
+#include "buffer_pool.hpp"
 #include "common.hpp"
+#include "conn_slab.hpp"
+#include "frame_buffer.hpp"
 #include "ipc_mq.hpp"
+#include "mpmc_ring.hpp"
+#include "mpsc_queue.hpp"
+#include "pending_table.hpp"
 #include "protocol.hpp"
+#include "shard_ring.hpp"
 #include "thread_pool.hpp"
+#include "timing_wheel.hpp"
+#include "transport.hpp"
+#include "uring.hpp"
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-#include <condition_variable>
-#include <deque>
+#include <cctype>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
 
 using namespace tr;
 
 namespace {
 
 constexpr int MAX_EVENTS = 256;
-constexpr size_t MAX_PENDING = 100000; // backpressure
+constexpr size_t MAX_PENDING = 131072; // backpressure (pending table capacity)
 constexpr int ACCEPT_BACKLOG = 512;
+constexpr uint64_t FLX_TIMEOUT_MS = 500;           // default per-transaction deadline
+constexpr uint64_t MAX_TXN_TIMEOUT_MS = 60000;     // cap for client-supplied timeout_ms
+constexpr uint64_t IDLE_TIMEOUT_MS = 300000;       // reap connections silent this long
+constexpr uint64_t TIMER_TICK_MS = 10;             // timing wheel resolution
+constexpr size_t READ_CHUNK = 4096;                // epoll read() size
+constexpr size_t MAX_BIN_PAYLOAD = 4096;           // larger binary frames drop the connection
+constexpr size_t MAX_JSON_LINE = 16384;            // more buffered without a newline drops the connection
+constexpr size_t MAX_CLIENT_ID = 22;               // raw JSON "id" token, bytes
+constexpr int RESP_IDLE_WAIT_MS = 200;             // dispatcher re-checks shutdown this often
+constexpr uint32_t MAX_SHARDS = 64;                // FLX engine shard ids are 0..MAX_SHARDS-1
+constexpr long FLX_MSG_SIZE = 8192;                // per-message bound of the FLX queues
+constexpr size_t MAX_FLX_PAYLOAD = FLX_MSG_SIZE - sizeof(MsgHdr); // longer JSON requests get bad_request
+constexpr int ADMIN_IDLE_TIMEOUT_S = 5;            // admin connections silent this long are closed
+constexpr size_t MAX_ADMIN_LINE = 1024;            // longer admin requests drop the connection
 
-struct Pending {
-  std::mutex mu;
-  std::condition_variable cv;
-  bool done{false};
-  std::string resp;
-};
+// io_uring backend sizing (per reactor)
+constexpr unsigned URING_ENTRIES = 4096;
+constexpr unsigned URING_RECV_BUFS = 1024;     // provided buffers
+constexpr unsigned URING_RECV_BUF_SIZE = 4096;
+constexpr uint16_t URING_RECV_BGID = 0;
+
+// Generational connection id (ConnSlab): what epoll, the flush list, timers
+// and in-flight transactions hold instead of the fd, so a response or timer
+// for a closed connection can never reach a newer one that reused its fd.
+using ConnId = uint64_t;
 
+// Ingress framing, decided by a connection's first byte: the MsgHdr magic
+// selects binary frames, anything else newline-delimited JSON.
+enum class Framing : uint8_t { Unknown, Json, Binary };
+
+// Hot fields first: everything a readiness event or flush touches sits in the
+// connection's first cache line (slots are line-aligned). The buffers borrow
+// blocks from the reactor's BufferPool only while they hold bytes, so an idle
+// connection is just this struct (two cache lines).
 struct Conn {
   int fd{-1};
-  std::string inbuf;
-  std::deque<std::string> outq;
   bool want_write{false};
+  bool sending{false}; // io_uring: one send in flight at a time
+  bool closing{false};
+  Framing framing{Framing::Unknown};
+  int inflight{0}; // io_uring: SQEs referencing fd; the fd is closed only at zero
+  ConnId id{0};
+  uint64_t last_active_ms{0};
+  ByteBuffer in;   // unframed input (partial frame carried between reads)
+  ByteBuffer out;  // responses not yet written
+
+  // io_uring backend: the in-flight send's bytes, pinned until it completes
+  ByteBuffer sendbuf;
+
+  uint64_t idle_timer{~uint64_t{0}};
+};
+using ConnTable = ConnSlab<Conn>;
+
+// epoll data.u64 of the reactor's non-connection fds
+constexpr ConnId EV_LISTEN = ConnTable::reserved(1);
+constexpr ConnId EV_WAKE = ConnTable::reserved(2);
+
+// What a reactor timer stands for when it fires.
+struct TimerEvent {
+  enum Kind : uint8_t { Txn, Idle } kind{Txn};
+  uint64_t arg{0}; // Txn: corr_id, Idle: ConnId
+};
+using ReactorTimers = TimingWheel<TimerEvent>;
+
+enum class IoBackend { Epoll, Uring };
+
+// A response finished off-reactor (worker or dispatcher), on its way to the
+// owning reactor.
+struct Completion {
+  ConnId conn{0};
+  uint64_t timer{0}; // transaction deadline to cancel
+  std::string line;
+};
+
+// One FLX engine shard: its queue pair and the thread dispatching its
+// responses. Forwarding tasks hold a reference, so a removed shard's queues
+// stay open until the last request sent through them has gone out.
+struct Shard {
+  uint32_t id{0};
+  MsgChannel req, resp;
+  std::atomic<bool> run{true};
+  std::atomic<bool> done{false}; // dispatcher has exited
+  std::thread dispatcher;
+};
+
+// Routing snapshot: ring membership and the shards it names. Immutable once
+// published; adding or removing a shard publishes a new one.
+struct ShardMap {
+  HashRing ring;
+  std::vector<std::shared_ptr<Shard>> shards;
+  std::vector<int> slot = std::vector<int>(MAX_SHARDS, -1); // shard id -> index in shards
+
+  // Index of the shard owning msisdn, or -1 when there is none.
+  int route(std::string_view msisdn) const {
+    if (ring.empty()) return -1;
+    return slot[ring.pick(msisdn_hash(msisdn))];
+  }
+};
+
+// One reactor per thread: own listen socket (SO_REUSEPORT), own epoll fd and
+// own connection table. Only the reactor thread touches its connections and
+// its epoll/io_uring state; other threads hand it completions through a
+// lock-free queue and an eventfd wakeup.
+struct Reactor {
+  int id{0};
+  IoBackend backend{IoBackend::Epoll};
+  int listen_fd{-1};
+  int ep{-1};
+  ConnTable conns;
+  std::thread th;
+
+  // Buffer blocks shared by this reactor's connections
+  BufferPool bufs;
+
+  // Cross-thread handoff: producers push, then write wake_fd unless a wakeup
+  // is already pending.
+  MpscQueue<Completion> completions;
+  Completion popped; // reactor_tick's pop target; its buffer cycles back into the queue
+  int wake_fd{-1};
+  std::atomic<bool> wake_pending{false};
+
+  // io_uring backend only
+  Uring ring;
+  UringBufPool recv_bufs;
+  uint64_t wake_val{0}; // target of the in-flight eventfd read
+  uint64_t accept_retry_ms{0}; // accept failed: re-arm at this time (0 = armed)
+
+  // Connections that got output on the reactor thread this iteration; flushed
+  // once each at the end of the iteration (both backends)
+  std::vector<ConnId> flush;
+
+  // Shard map this reactor routes with; a newer one is picked up between
+  // iterations.
+  std::shared_ptr<const ShardMap> shards;
+  uint64_t shards_version{0};
+
+  // Requests parsed this iteration, one batch per shard (requests[i] goes to
+  // shards->shards[i]), sent to FLX as Batch envelopes of up to --batch-bytes
+  // when the iteration ends.
+  std::vector<BatchBuilder> requests;
+
+  // Transaction deadlines and idle-connection timers, advanced every tick.
+  ReactorTimers timers{TIMER_TICK_MS, steady_millis()};
+};
+
+// How the client named a request, echoed in its answer so pipelined clients
+// can match out-of-order responses: binary frames carry a corr_id tag, JSON
+// requests an optional "id" (kept as its raw token, string or number).
+struct ReplyTo {
+  uint64_t tag{0};
+  Framing framing{Framing::Json};
+  uint8_t id_len{0};
+  char id[MAX_CLIENT_ID]{};
+
+  std::string_view client_id() const { return std::string_view(id, id_len); }
+  void set_client_id(std::string_view v) {
+    id_len = static_cast<uint8_t>(v.size());
+    std::memcpy(id, v.data(), v.size());
+  }
+};
+
+// In-flight transaction: where to deliver the response, how to address it,
+// and which reactor timer to cancel. No thread waits on it; whoever removes
+// it from the table completes it.
+struct Pending {
+  Reactor* owner{nullptr};
+  ConnId conn{0};
+  uint64_t timer{0};
+  ReplyTo reply;
+};
+
+struct ServerOptions {
+  std::string host{"0.0.0.0"};
+  int port{5555};
+  size_t reactors{1};
+  IoBackend backend{IoBackend::Epoll};
+  Transport transport{Transport::Mq};
+  uint64_t txn_timeout_ms{FLX_TIMEOUT_MS};
+  uint64_t idle_timeout_ms{IDLE_TIMEOUT_MS}; // 0 disables reaping
+  size_t batch_bytes{8192}; // MQ batch envelope bound; 0 sends every request alone
+  uint32_t shards{1};       // FLX engine shards 0..shards-1 at startup
+  int admin_port{0};        // shard administration on 127.0.0.1; 0 disables it
 };
 
 int set_nonblock(int fd) {
@@ -45,36 +225,98 @@ int set_nonblock(int fd) {
   return 0;
 }
 
-std::string trim_newline(std::string s) {
-  while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
-  return s;
+// Minimal JSON extraction for demo: "key":123
+std::optional<uint64_t> json_get_uint(std::string_view j, const char* key) {
+  const std::string pat = std::string("\"") + key + "\"";
+  auto k = j.find(pat);
+  if (k == std::string_view::npos) return std::nullopt;
+  auto colon = j.find(':', k + pat.size());
+  if (colon == std::string_view::npos) return std::nullopt;
+  auto d = j.find_first_not_of(" \t", colon + 1);
+  if (d == std::string_view::npos || j[d] < '0' || j[d] > '9') return std::nullopt;
+  uint64_t v = 0;
+  for (; d < j.size() && j[d] >= '0' && j[d] <= '9'; ++d) v = v * 10 + static_cast<uint64_t>(j[d] - '0');
+  return v;
 }
 
-} // namespace
-
-int main(int argc, char** argv) {
-  std::string host = "0.0.0.0";
-  int port = 5555;
-  if (argc >= 2) host = argv[1];
-  if (argc >= 3) port = std::atoi(argv[2]);
-
-  const std::string REQ  = "/tr_mq_req";
-  const std::string RESP = "/tr_mq_resp";
-
-  PosixMq mq_req, mq_resp;
-  // Server expects queues already created (engine creates them).
-  mq_req.open(MqConfig{REQ, 2048, 8192, false, true});   // nonblock helps under load
-  mq_resp.open(MqConfig{RESP, 2048, 8192, false, true}); // nonblock for dispatcher polling
+// Raw JSON token of "key": a string (quotes included) or a number. nullopt if
+// the key is absent, an empty view if its value is neither.
+std::optional<std::string_view> json_get_token(std::string_view j, const char* key) {
+  const std::string pat = std::string("\"") + key + "\"";
+  auto k = j.find(pat);
+  if (k == std::string_view::npos) return std::nullopt;
+  auto colon = j.find(':', k + pat.size());
+  if (colon == std::string_view::npos) return std::string_view{};
+  auto d = j.find_first_not_of(" \t", colon + 1);
+  if (d == std::string_view::npos) return std::string_view{};
+  size_t e = d;
+  if (j[d] == '"') {
+    for (e = d + 1; e < j.size() && j[e] != '"'; ++e) {
+      if (j[e] == '\\') ++e;
+    }
+    if (e >= j.size()) return std::string_view{};
+    ++e;
+  } else {
+    while (e < j.size() && (std::isdigit(static_cast<unsigned char>(j[e])) || j[e] == '-' || j[e] == '.' ||
+                            j[e] == 'e' || j[e] == 'E' || j[e] == '+')) {
+      ++e;
+    }
+  }
+  return j.substr(d, e - d);
+}
 
-  log_info("Routing server starting on " + host + ":" + std::to_string(port));
+ServerOptions parse_options(int argc, char** argv) {
+  ServerOptions o;
+  std::vector<std::string> pos;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    if (a.rfind("--reactors=", 0) == 0) {
+      o.reactors = static_cast<size_t>(std::max(1, std::atoi(a.c_str() + 11)));
+    } else if (a.rfind("--txn-timeout-ms=", 0) == 0) {
+      o.txn_timeout_ms = std::max<uint64_t>(1, std::strtoull(a.c_str() + 17, nullptr, 10));
+    } else if (a.rfind("--idle-timeout-ms=", 0) == 0) {
+      o.idle_timeout_ms = std::strtoull(a.c_str() + 18, nullptr, 10);
+    } else if (a.rfind("--batch-bytes=", 0) == 0) {
+      o.batch_bytes = std::strtoull(a.c_str() + 14, nullptr, 10);
+    } else if (a.rfind("--shards=", 0) == 0) {
+      const long n = std::atol(a.c_str() + 9);
+      if (n < 1 || n > static_cast<long>(MAX_SHARDS)) {
+        throw std::runtime_error("bad " + a + " (1.." + std::to_string(MAX_SHARDS) + ")");
+      }
+      o.shards = static_cast<uint32_t>(n);
+    } else if (a.rfind("--admin-port=", 0) == 0) {
+      const long p = std::atol(a.c_str() + 13);
+      if (p < 1 || p > 65535) throw std::runtime_error("bad " + a);
+      o.admin_port = static_cast<int>(p);
+    } else if (a == "--io=epoll") {
+      o.backend = IoBackend::Epoll;
+    } else if (a == "--io=uring") {
+      o.backend = IoBackend::Uring;
+    } else if (a.rfind("--transport=", 0) == 0) {
+      const auto t = parse_transport(a.substr(12));
+      if (!t) throw std::runtime_error("bad " + a + " (expected mq or shm)");
+      o.transport = *t;
+    } else if (a.rfind("--", 0) == 0) {
+      throw std::runtime_error("unknown option " + a);
+    } else {
+      pos.push_back(a);
+    }
+  }
+  if (pos.size() >= 1) o.host = pos[0];
+  if (pos.size() >= 2) o.port = std::atoi(pos[1].c_str());
+  return o;
+}
 
+// A reactor's listener is non-blocking and shares its port with the other
+// reactors (SO_REUSEPORT); the admin listener is neither.
+int open_listener(const std::string& host, int port, bool reactor = true) {
   int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
   if (listen_fd < 0) throw std::runtime_error("socket failed");
 
   int yes = 1;
   (void)setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
 #ifdef SO_REUSEPORT
-  (void)setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+  if (reactor) (void)setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
 #endif
 
   sockaddr_in addr{};
@@ -86,232 +328,1017 @@ int main(int argc, char** argv) {
   if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
     throw std::runtime_error("bind failed: " + std::string(std::strerror(errno)));
   }
-  if (set_nonblock(listen_fd) != 0) throw std::runtime_error("listen nonblock failed");
+  if (reactor && set_nonblock(listen_fd) != 0) throw std::runtime_error("listen nonblock failed");
   if (listen(listen_fd, ACCEPT_BACKLOG) != 0) throw std::runtime_error("listen failed");
+  return listen_fd;
+}
 
-  int ep = epoll_create1(0);
-  if (ep < 0) throw std::runtime_error("epoll_create1 failed");
+// State shared by all reactors: the FLX shards, the pending-transaction table and
+// the worker pool. Reactors only touch it when handing a request off.
+struct Server {
+  ServerOptions opt;
 
-  epoll_event ev{};
-  ev.events = EPOLLIN;
-  ev.data.fd = listen_fd;
-  if (epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &ev) != 0) {
-    throw std::runtime_error("epoll_ctl add listen failed");
+  // Current shard map. Replaced under shard_mu, which also bumps
+  // shard_version; reactors compare versions once per iteration.
+  std::mutex shard_mu;
+  std::shared_ptr<const ShardMap> shards;
+  std::atomic<uint64_t> shard_version{0};
+  std::vector<std::shared_ptr<Shard>> retired; // removed, dispatcher not yet joined
+
+  // Request batch buffers that workers have finished sending, for reactors
+  // to refill instead of allocating new ones.
+  MpmcRing<std::string> spare_batches{1024};
+
+  // Pending transactions; the slot index + generation is the corr_id
+  PendingTable<Pending> pending{MAX_PENDING};
+
+  std::unique_ptr<ThreadPool> pool;
+};
+
+// Return c's buffer blocks to the pool and drop c from the table.
+void destroy_conn(Reactor& r, Conn& c) {
+  r.timers.cancel(c.idle_timer);
+  c.in.release(r.bufs);
+  c.out.release(r.bufs);
+  c.sendbuf.release(r.bufs);
+  r.conns.erase(c.id);
+}
+
+// Destroys c.
+void close_conn(Reactor& r, Conn& c) {
+  (void)epoll_ctl(r.ep, EPOLL_CTL_DEL, c.fd, nullptr);
+  ::close(c.fd);
+  destroy_conn(r, c);
+}
+
+void enable_write(Reactor& r, Conn& c, bool on) {
+  epoll_event e{};
+  e.data.u64 = c.id;
+  e.events = EPOLLIN | (on ? EPOLLOUT : 0);
+  (void)epoll_ctl(r.ep, EPOLL_CTL_MOD, c.fd, &e);
+  c.want_write = on;
+}
+
+// Worker/dispatcher side: hand a finished response to the reactor that owns
+// the connection. write(std::string&) produces the response bytes straight
+// into a recycled completion, whose buffer is normally big enough already.
+// Never blocks and never touches the reactor's connections or kernel state;
+// at most one eventfd write per reactor wakeup.
+template <class F>
+void post_response(Reactor& r, ConnId conn, uint64_t timer, F&& write) {
+  r.completions.push_with([&](Completion& done) {
+    done.conn = conn;
+    done.timer = timer;
+    done.line.clear();
+    write(done.line);
+  });
+  if (!r.wake_pending.exchange(true, std::memory_order_acq_rel)) {
+    const uint64_t one = 1;
+    (void)!::write(r.wake_fd, &one, sizeof(one));
   }
+}
 
-  // Connection table
-  std::unordered_map<int, Conn> conns;
+// Reactor side: the eventfd fired. Re-enable producer wakeups before the
+// queue is drained (reactor_tick) so nothing pushed after the drain is missed.
+void on_wake(Reactor& r) {
+  (void)r.wake_pending.exchange(false, std::memory_order_acq_rel);
+}
 
-  // Pending response map (corr_id -> Pending)
-  std::mutex pend_mu;
-  std::unordered_map<uint64_t, std::shared_ptr<Pending>> pending;
+// Reactor side: queue bytes for c; they go out with everything else queued
+// for it when the iteration's flush runs. Non-empty output is already
+// scheduled (flush list, EPOLLOUT or in-flight send).
+void queue_output(Reactor& r, Conn& c, std::string_view s) {
+  const bool first = c.out.empty();
+  c.out.append(r.bufs, s.data(), s.size());
+  if (first) r.flush.push_back(c.id);
+}
 
-  // Response dispatcher thread (reads MQ RESP and completes pending)
-  std::atomic<bool> run{true};
-  std::thread resp_thread([&]{
-    std::vector<uint8_t> buf(static_cast<size_t>(mq_resp.msgsize()));
-    while (run.load()) {
-      ssize_t n = -1;
-      try { n = mq_resp.recv(buf.data(), buf.size(), nullptr); }
-      catch (const std::exception& e) {
-        log_err(std::string("resp mq recv: ") + e.what());
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        continue;
+// Epoll: write as much of the output as the socket takes; the responses
+// queued since the last flush are contiguous, so this is one send() per
+// flush. EPOLLOUT stays armed only while bytes remain; a drained buffer goes
+// back to the pool. Returns false if the connection was closed (c is gone).
+bool epoll_flush(Reactor& r, Conn& c) {
+  while (!c.out.empty()) {
+    const ssize_t w = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      close_conn(r, c);
+      return false;
+    }
+    c.last_active_ms = steady_millis();
+    c.out.consume(static_cast<size_t>(w));
+  }
+  c.out.release_if_empty(r.bufs);
+  const bool more = !c.out.empty();
+  if (more != c.want_write) enable_write(r, c, more);
+  return true;
+}
+
+// Append a JSON object as a response line, with the client's "id" (if any)
+// first.
+void append_json_line(std::string& out, const ReplyTo& to, std::string_view obj) {
+  const auto id = to.client_id();
+  if (id.empty() || obj.empty() || obj[0] != '{') {
+    out.append(obj);
+  } else {
+    out += "{\"id\":";
+    out += id;
+    if (obj.size() > 2) out += ',';
+    out.append(obj.substr(1));
+  }
+  out += '\n';
+}
+
+std::string json_line(const ReplyTo& to, std::string_view obj) {
+  std::string out;
+  out.reserve(obj.size() + to.id_len + 8);
+  append_json_line(out, to, obj);
+  return out;
+}
+
+// Append FLX's response payload, framed for the client that asked.
+void append_client_reply(std::string& out, const ReplyTo& to, std::string_view payload) {
+  if (to.framing == Framing::Json) {
+    append_json_line(out, to, payload);
+    return;
+  }
+  const size_t at = out.size();
+  out.resize(at + sizeof(MsgHdr) + payload.size());
+  (void)pack_into(out.data() + at, out.size() - at, MsgType::RouteRespBin, to.tag, payload);
+}
+
+std::string client_reply(const ReplyTo& to, std::string_view payload) {
+  std::string out;
+  append_client_reply(out, to, payload);
+  return out;
+}
+
+// An answer the server produces itself (BUSY, TIMEOUT, ERROR).
+std::string server_reply(const ReplyTo& to, RouteStatus st, RouteReason why) {
+  if (to.framing == Framing::Binary) {
+    BinRouteResp b{};
+    b.status = static_cast<uint16_t>(st);
+    b.reason = static_cast<uint16_t>(why);
+    return client_reply(to, std::string_view(reinterpret_cast<const char*>(&b), sizeof(b)));
+  }
+  return json_line(to, std::string("{\"status\":\"") + status_name(st) + "\",\"reason\":\"" + reason_name(why) + "\"}");
+}
+
+// Remove corr from the pending table and deliver FLX's response payload to
+// its connection. Returns false if the transaction was already completed (or
+// timed out).
+bool complete_pending(Server& srv, uint64_t corr, std::string_view payload) {
+  auto p = srv.pending.take(corr);
+  if (!p) return false;
+  post_response(*p->owner, p->conn, p->timer,
+                [&](std::string& out) { append_client_reply(out, p->reply, payload); });
+  return true;
+}
+
+// Same, answering with a server-side error instead.
+bool fail_pending(Server& srv, uint64_t corr, RouteReason why) {
+  auto p = srv.pending.take(corr);
+  if (!p) return false;
+  post_response(*p->owner, p->conn, p->timer,
+                [&](std::string& out) { out += server_reply(p->reply, RouteStatus::Error, why); });
+  return true;
+}
+
+// Call f(corr_id) for every request in msg (a single message or a Batch).
+template <class F>
+void for_each_corr(const std::string& msg, F&& f) {
+  MsgHdr h;
+  std::memcpy(&h, msg.data(), sizeof(MsgHdr));
+  if (static_cast<MsgType>(h.type) != MsgType::Batch) {
+    f(h.corr_id);
+    return;
+  }
+  (void)unpack_batch(std::string_view(msg).substr(sizeof(MsgHdr)),
+                     [&](const MsgHdr& rh, std::string_view) { f(rh.corr_id); });
+}
+
+// Send msg to an FLX shard from a worker. The shard's response dispatcher
+// completes its transactions when FLX answers; if the send fails they are
+// failed here. The buffer then goes back to the server for the next batch.
+void forward_to_flx(Server& srv, std::shared_ptr<Shard> shard, std::string msg) {
+  auto forward = [&srv, shard=std::move(shard), msg=std::move(msg)]() mutable {
+    RouteReason why = RouteReason::None;
+    try {
+      // Retry send if MQ is temporarily full
+      bool sent = false;
+      for (int k = 0; k < 1000 && !sent; ++k) {
+        sent = shard->req.send(reinterpret_cast<const uint8_t*>(msg.data()), msg.size(), 0);
+        if (!sent) std::this_thread::sleep_for(std::chrono::microseconds(200));
       }
-      if (n < 0) { // EAGAIN
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        continue;
+      if (!sent) why = RouteReason::MqFull;
+    } catch (const std::exception& e) {
+      log_err(std::string("worker req error: ") + e.what());
+      why = RouteReason::MqSend;
+    }
+    if (why != RouteReason::None) for_each_corr(msg, [&](uint64_t corr) { (void)fail_pending(srv, corr, why); });
+    msg.clear();
+    (void)srv.spare_batches.try_push(std::move(msg));
+  };
+  static_assert(Task::fits_inline<decltype(forward)>, "request forwarding must not heap-allocate its task");
+  srv.pool->submit(std::move(forward));
+}
+
+// Hand batch's contents to a worker for dest, and give the builder a
+// buffer that a worker has finished sending, if one is spare.
+void send_batch(Server& srv, const std::shared_ptr<Shard>& dest, BatchBuilder& batch) {
+  forward_to_flx(srv, dest, batch.take());
+  std::string spare;
+  if (srv.spare_batches.try_pop(spare)) batch.recycle(std::move(spare));
+}
+
+// Take the current shard map and size the per-shard batches to it.
+void adopt_shards(Server& srv, Reactor& r) {
+  std::lock_guard<std::mutex> lk(srv.shard_mu);
+  r.shards = srv.shards;
+  r.shards_version = srv.shard_version.load(std::memory_order_relaxed);
+  r.requests.assign(r.shards->shards.size(), BatchBuilder(srv.opt.batch_bytes));
+}
+
+// End of a reactor iteration: hand what was batched to workers, one message
+// per shard, then move to a newer shard map if one was published. A batch is
+// always sent to the shard it was routed to.
+void flush_requests(Server& srv, Reactor& r) {
+  for (size_t i = 0; i < r.requests.size(); ++i) {
+    if (!r.requests[i].empty()) send_batch(srv, r.shards->shards[i], r.requests[i]);
+  }
+  if (srv.shard_version.load(std::memory_order_acquire) != r.shards_version) adopt_shards(srv, r);
+}
+
+// Register a request and encode it (type, payload, the corr_id assigned here)
+// straight into the batch for the FLX shard owning msisdn. Returns why nothing
+// was queued: the pending table is full (Overload) or there is no shard
+// (NoShard).
+RouteReason submit_request(Server& srv, Reactor& r, const Conn& c, const ReplyTo& to, std::string_view msisdn,
+                           std::optional<uint64_t> timeout_ms, MsgType type, std::string_view payload) {
+  const int shard = r.shards->route(msisdn);
+  if (shard < 0) return RouteReason::NoShard;
+
+  // Per-request deadline if the client gave one, else the server default.
+  uint64_t timeout = srv.opt.txn_timeout_ms;
+  if (timeout_ms) timeout = std::min(std::max<uint64_t>(*timeout_ms, 1), MAX_TXN_TIMEOUT_MS);
+
+  const auto timer = r.timers.schedule(steady_millis() + timeout, TimerEvent{TimerEvent::Txn, 0});
+  const auto id = srv.pending.insert(Pending{&r, c.id, timer, to});
+  if (!id) {
+    r.timers.cancel(timer);
+    return RouteReason::Overload;
+  }
+  const uint64_t corr = *id;
+  r.timers.update(timer, TimerEvent{TimerEvent::Txn, corr});
+
+  const auto& dest = r.shards->shards[static_cast<size_t>(shard)];
+  auto& batch = r.requests[static_cast<size_t>(shard)];
+  if (!batch.fits(sizeof(MsgHdr) + payload.size())) send_batch(srv, dest, batch);
+  batch.add(type, corr, payload);
+  if (srv.opt.batch_bytes == 0) send_batch(srv, dest, batch); // unbatched: a lone record goes out as itself
+  return RouteReason::None;
+}
+
+// Answer a request the server did not hand to FLX.
+void reject(Reactor& r, Conn& c, const ReplyTo& to, RouteReason why) {
+  const auto st = why == RouteReason::Overload ? RouteStatus::Busy : RouteStatus::Error;
+  queue_output(r, c, server_reply(to, st, why));
+}
+
+// Shard sh's response dispatcher: wait until the response channel is
+// readable (epoll on the MQ descriptor, futex on the shm ring), drain
+// everything queued per wakeup and hand each response to its reactor.
+// Messages are decoded in place in the receive buffer. Once stopped it keeps
+// going until the queue has been quiet for RESP_IDLE_WAIT_MS, so requests
+// already sent to a removed shard are still answered.
+void dispatch_responses(Server& srv, Shard& sh) {
+  auto on_msg = [&](const uint8_t* data, size_t n) {
+    const auto m = unpack_view(data, n);
+    if (!m) return;
+    const MsgHdr& h = m->hdr;
+    const std::string_view payload = m->payload;
+    const auto type = static_cast<MsgType>(h.type);
+    if (type == MsgType::Batch) {
+      const bool ok = unpack_batch(payload, [&](const MsgHdr& rh, std::string_view rp) {
+        const auto rt = static_cast<MsgType>(rh.type);
+        if (rt == MsgType::RouteResp || rt == MsgType::RouteRespBin) (void)complete_pending(srv, rh.corr_id, rp);
+      });
+      if (!ok) log_warn("malformed response batch");
+      return;
+    }
+    if (type != MsgType::RouteResp && type != MsgType::RouteRespBin) return;
+
+    // Hand the response straight to the owning reactor; late responses for
+    // timed-out transactions are dropped here.
+    (void)complete_pending(srv, h.corr_id, payload);
+  };
+  for (;;) {
+    bool got = false;
+    try {
+      if (sh.resp.wait_readable(RESP_IDLE_WAIT_MS)) {
+        while (sh.resp.recv_with(on_msg)) got = true;
       }
+    } catch (const std::exception& e) {
+      log_err(std::string("resp recv: ") + e.what());
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      got = true;
+    }
+    if (!got && !sh.run.load()) break;
+  }
+  sh.done = true;
+}
+
+// Open shard id's queue pair (its engine creates them) and start its
+// dispatcher. Throws if the queues cannot be opened.
+std::shared_ptr<Shard> open_shard(Server& srv, uint32_t id) {
+  auto sh = std::make_shared<Shard>();
+  sh->id = id;
+  const Transport t = srv.opt.transport;
+  // Both non-blocking: requests because a full queue is retried by the
+  // worker, responses because the dispatcher waits with wait_readable().
+  sh->req.open(t, MqConfig{channel_name(t, "req", id), 2048, FLX_MSG_SIZE, false, true});
+  sh->resp.open(t, MqConfig{channel_name(t, "resp", id), 2048, FLX_MSG_SIZE, false, true});
+  sh->dispatcher = std::thread([&srv, p = sh.get()] { dispatch_responses(srv, *p); });
+  return sh;
+}
+
+// Publish a new shard map over `shards` (shard_mu held).
+void publish_shards(Server& srv, std::vector<std::shared_ptr<Shard>> shards) {
+  auto m = std::make_shared<ShardMap>();
+  for (size_t i = 0; i < shards.size(); ++i) {
+    m->ring.add(shards[i]->id);
+    m->slot[shards[i]->id] = static_cast<int>(i);
+  }
+  m->shards = std::move(shards);
+  srv.shards = std::move(m);
+  srv.shard_version.fetch_add(1, std::memory_order_release);
+}
+
+// Join the dispatchers of removed shards that have wound down (shard_mu held).
+void reap_shards(Server& srv) {
+  auto& v = srv.retired;
+  for (auto it = v.begin(); it != v.end();) {
+    if (!(*it)->done.load()) {
+      ++it;
+      continue;
+    }
+    (*it)->dispatcher.join();
+    it = v.erase(it);
+  }
+}
+
+// Admin: put engine shard id on the ring; its engine must already be
+// running. Only the keys on the arcs it takes over move to it. The queues
+// are opened before shard_mu is taken, which only covers the swap.
+RouteReason add_shard(Server& srv, uint64_t id) {
+  if (id >= MAX_SHARDS) return RouteReason::BadRequest;
+  {
+    std::lock_guard<std::mutex> lk(srv.shard_mu);
+    if (srv.shards->slot[id] >= 0) return RouteReason::BadRequest;
+  }
+  std::shared_ptr<Shard> sh;
+  try {
+    sh = open_shard(srv, static_cast<uint32_t>(id));
+  } catch (const std::exception& e) {
+    log_warn("FLX shard " + std::to_string(id) + " not added: " + e.what());
+    return RouteReason::NoShard;
+  }
+  std::lock_guard<std::mutex> lk(srv.shard_mu);
+  reap_shards(srv);
+  if (srv.shards->slot[id] >= 0) { // added meanwhile
+    sh->run = false;
+    srv.retired.push_back(std::move(sh));
+    return RouteReason::BadRequest;
+  }
+  auto all = srv.shards->shards;
+  all.push_back(std::move(sh));
+  publish_shards(srv, std::move(all));
+  log_info("FLX shard " + std::to_string(id) + " added, shards=" + std::to_string(srv.shards->shards.size()));
+  return RouteReason::None;
+}
+
+// Admin: take shard id off the ring; its keys move to the shards next to it
+// on the ring and nothing else moves.
+RouteReason remove_shard(Server& srv, uint64_t id) {
+  if (id >= MAX_SHARDS) return RouteReason::BadRequest;
+  std::lock_guard<std::mutex> lk(srv.shard_mu);
+  reap_shards(srv);
+  const int i = srv.shards->slot[id];
+  if (i < 0) return RouteReason::BadRequest;
+  auto all = srv.shards->shards;
+  all[static_cast<size_t>(i)]->run = false;
+  srv.retired.push_back(all[static_cast<size_t>(i)]);
+  all.erase(all.begin() + i);
+  publish_shards(srv, std::move(all));
+  log_info("FLX shard " + std::to_string(id) + " removed, shards=" + std::to_string(srv.shards->shards.size()));
+  return RouteReason::None;
+}
 
-      MsgHdr h{};
-      std::string payload;
-      if (!unpack(buf.data(), static_cast<size_t>(n), h, payload)) continue;
-      if (static_cast<MsgType>(h.type) != MsgType::RouteResp) continue;
+// {"status":"OK","shards":[0,1,...]}
+std::string shard_list(Server& srv) {
+  std::vector<uint32_t> ids;
+  {
+    std::lock_guard<std::mutex> lk(srv.shard_mu);
+    for (const auto& sh : srv.shards->shards) ids.push_back(sh->id);
+  }
+  std::sort(ids.begin(), ids.end());
+  std::string out = "{\"status\":\"OK\",\"shards\":[";
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (i) out += ',';
+    out += std::to_string(ids[i]);
+  }
+  out += "]}";
+  return out;
+}
+
+bool is_admin_op(std::string_view op) {
+  return op == "\"shard_add\"" || op == "\"shard_remove\"" || op == "\"shards\"";
+}
+
+// One admin request: {"op":"shard_add","shard":N}, {"op":"shard_remove",
+// "shard":N} or {"op":"shards"}, answered with the resulting membership.
+std::string admin_request(Server& srv, std::string_view line) {
+  ReplyTo to;
+  if (auto id = json_get_token(line, "id"); id && !id->empty() && id->size() <= MAX_CLIENT_ID) {
+    to.set_client_id(*id);
+  }
+  const auto op = json_get_token(line, "op");
+  if (!op || !is_admin_op(*op)) return server_reply(to, RouteStatus::Error, RouteReason::BadRequest);
+  if (*op != "\"shards\"") {
+    const bool add = *op == "\"shard_add\"";
+    const auto id = json_get_uint(line, "shard");
+    const auto why = !id ? RouteReason::BadRequest : add ? add_shard(srv, *id) : remove_shard(srv, *id);
+    if (why != RouteReason::None) return server_reply(to, RouteStatus::Error, why);
+  }
+  return json_line(to, shard_list(srv));
+}
 
-      std::shared_ptr<Pending> p;
-      {
-        std::lock_guard<std::mutex> lk(pend_mu);
-        auto it = pending.find(h.corr_id);
-        if (it != pending.end()) { p = it->second; pending.erase(it); }
+// Serve one admin connection: newline-framed requests, answered in order,
+// until EOF, an error or ADMIN_IDLE_TIMEOUT_S of silence.
+void serve_admin(Server& srv, int fd) {
+  timeval tv{ADMIN_IDLE_TIMEOUT_S, 0};
+  (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  (void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  std::string in;
+  char chunk[READ_CHUNK];
+  for (;;) {
+    const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) continue;
+      return;
+    }
+    in.append(chunk, static_cast<size_t>(n));
+    size_t nl;
+    while ((nl = in.find('\n')) != std::string::npos) {
+      const std::string out = admin_request(srv, std::string_view(in).substr(0, nl));
+      in.erase(0, nl + 1);
+      for (size_t off = 0; off < out.size();) {
+        const ssize_t w = ::send(fd, out.data() + off, out.size() - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        off += static_cast<size_t>(w);
       }
-      if (p) {
-        std::lock_guard<std::mutex> lk(p->mu);
-        p->resp = payload;
-        p->done = true;
-        p->cv.notify_one();
+    }
+    if (in.size() > MAX_ADMIN_LINE) return;
+  }
+}
+
+// Shard administration (--admin-port): its own thread and a listener on
+// loopback only, one connection at a time, so opening a shard's queues never
+// stalls a reactor and clients on the routing port cannot change the ring.
+void admin_loop(Server& srv, int listen_fd) {
+  for (;;) {
+    const int fd = ::accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno != EINTR) {
+        log_warn("admin accept error: " + std::string(std::strerror(errno)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
       }
+      continue;
     }
-  });
+    serve_admin(srv, fd);
+    ::close(fd);
+  }
+}
 
-  // Worker pool for request processing (MQ send + wait response)
-  const size_t nworkers = std::max<size_t>(2, std::thread::hardware_concurrency());
-  ThreadPool pool(nworkers);
+// One line-framed JSON request.
+void on_line(Server& srv, Reactor& r, Conn& c, std::string_view line) {
+  ReplyTo to;
+  if (auto id = json_get_token(line, "id")) {
+    if (id->empty() || id->size() > MAX_CLIENT_ID) {
+      reject(r, c, to, RouteReason::BadRequest);
+      return;
+    }
+    to.set_client_id(*id);
+  }
+  if (line.size() > MAX_FLX_PAYLOAD) { // would not fit a message to FLX
+    reject(r, c, to, RouteReason::BadRequest);
+    return;
+  }
+  if (auto op = json_get_token(line, "op"); op && is_admin_op(*op)) {
+    reject(r, c, to, RouteReason::BadRequest); // admin ops go to --admin-port only
+    return;
+  }
+  // The raw token is enough to route on: msisdn_hash only looks at digits.
+  const auto msisdn = json_get_token(line, "msisdn").value_or(std::string_view{});
+  const auto why = submit_request(srv, r, c, to, msisdn, json_get_uint(line, "timeout_ms"), MsgType::RouteReq, line);
+  if (why != RouteReason::None) reject(r, c, to, why);
+}
 
-  auto close_conn = [&](int fd) {
-    (void)epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
-    ::close(fd);
-    conns.erase(fd);
-  };
+// One binary frame (MsgHdr + BinRouteReq, or BinUpdateLocReq); FLX gets
+// the same payload under a header carrying the server's corr_id.
+void on_msg(Server& srv, Reactor& r, Conn& c, const MsgHdr& h, std::string_view frame) {
+  ReplyTo to;
+  to.framing = Framing::Binary;
+  to.tag = h.corr_id;
+  const auto type = static_cast<MsgType>(h.type);
+  const bool ok = (type == MsgType::RouteReqBin && h.payload_len == sizeof(BinRouteReq)) ||
+                  (type == MsgType::UpdateLocReqBin && h.payload_len == sizeof(BinUpdateLocReq));
+  if (!ok) {
+    reject(r, c, to, RouteReason::BadRequest);
+    return;
+  }
+  BinRouteReq req; // the common prefix: msisdn and timeout
+  std::memcpy(&req, frame.data() + sizeof(MsgHdr), sizeof(req));
+  std::optional<uint64_t> timeout;
+  if (req.timeout_ms) timeout = req.timeout_ms;
+  const auto why = submit_request(srv, r, c, to, fixed_str(req.msisdn), timeout, type, frame.substr(sizeof(MsgHdr)));
+  if (why != RouteReason::None) reject(r, c, to, why);
+}
 
-  auto enable_write = [&](int fd, bool on) {
-    auto it = conns.find(fd);
-    if (it == conns.end()) return;
-    epoll_event e{};
-    e.data.fd = fd;
-    e.events = EPOLLIN | (on ? EPOLLOUT : 0);
-    (void)epoll_ctl(ep, EPOLL_CTL_MOD, fd, &e);
-    it->second.want_write = on;
-  };
+// Dispatch every complete frame in [p, p+n) in the connection's framing.
+// Returns the bytes consumed, or nullopt if the binary stream is corrupt or
+// a JSON line runs past MAX_JSON_LINE, and the connection has to go.
+std::optional<size_t> scan_input(Server& srv, Reactor& r, Conn& c, const char* p, size_t n) {
+  if (c.framing == Framing::Unknown) {
+    if (n == 0) return 0;
+    c.framing = p[0] == static_cast<char>(MSG_MAGIC & 0xFF) ? Framing::Binary : Framing::Json;
+  }
+  if (c.framing == Framing::Json) {
+    const size_t used = scan_lines(p, n, [&](std::string_view line) { on_line(srv, r, c, line); });
+    if (n - used > MAX_JSON_LINE) return std::nullopt;
+    return used;
+  }
+  bool bad = false;
+  const size_t used = scan_msgs(p, n, MAX_BIN_PAYLOAD, bad,
+                                [&](const MsgHdr& h, std::string_view frame) { on_msg(srv, r, c, h, frame); });
+  if (bad) return std::nullopt;
+  return used;
+}
+
+// Dispatch the complete frames buffered in c.in (epoll: read() lands there).
+// Returns false on a framing error.
+bool on_input(Server& srv, Reactor& r, Conn& c) {
+  c.last_active_ms = steady_millis();
+  const auto used = scan_input(srv, r, c, c.in.data(), c.in.size());
+  if (!used) return false;
+  c.in.consume(*used);
+  return true;
+}
+
+// Dispatch frames straight out of a received buffer (io_uring provided
+// buffer). Only a trailing partial frame, or input following one, is copied
+// into c.in, which lets go of its block once the frame completes.
+bool on_input(Server& srv, Reactor& r, Conn& c, const char* data, size_t n) {
+  if (!c.in.empty()) {
+    c.in.append(r.bufs, data, n);
+    const bool ok = on_input(srv, r, c);
+    c.in.release_if_empty(r.bufs);
+    return ok;
+  }
+  c.last_active_ms = steady_millis();
+  const auto used = scan_input(srv, r, c, data, n);
+  if (!used) return false;
+  if (*used < n) c.in.append(r.bufs, data + *used, n - *used);
+  return true;
+}
+
+void uring_begin_close(Conn& c);
+
+void start_conn_timers(Server& srv, Reactor& r, Conn& c) {
+  c.last_active_ms = steady_millis();
+  if (srv.opt.idle_timeout_ms > 0) {
+    c.idle_timer = r.timers.schedule(c.last_active_ms + srv.opt.idle_timeout_ms,
+                                     TimerEvent{TimerEvent::Idle, c.id});
+  }
+}
+
+// Once per loop iteration: take in responses completed elsewhere (cancelling
+// their deadlines), then fire whatever is due (transaction timeouts, idle
+// connections).
+void reactor_tick(Server& srv, Reactor& r) {
+  Completion& done = r.popped;
+  while (r.completions.pop(done)) {
+    r.timers.cancel(done.timer);
+    Conn* c = r.conns.get(done.conn); // gone if the client hung up meanwhile
+    if (c && !c->closing) queue_output(r, *c, done.line);
+  }
+
+  const uint64_t now = steady_millis();
+  r.timers.advance(now, [&](const TimerEvent& ev) {
+    if (ev.kind == TimerEvent::Txn) {
+      auto p = srv.pending.take(ev.arg);
+      if (!p) return; // answered in the meantime
+      Conn* c = r.conns.get(p->conn);
+      if (c && !c->closing) {
+        queue_output(r, *c, server_reply(p->reply, RouteStatus::Timeout, RouteReason::FlxNoResponse));
+      }
+      return;
+    }
 
+    Conn* cp = r.conns.get(ev.arg);
+    if (!cp || cp->closing) return;
+    Conn& c = *cp;
+    c.idle_timer = ReactorTimers::INVALID;
+    if (now - c.last_active_ms < srv.opt.idle_timeout_ms) {
+      c.idle_timer = r.timers.schedule(c.last_active_ms + srv.opt.idle_timeout_ms, ev);
+      return;
+    }
+    if (r.backend == IoBackend::Epoll) close_conn(r, c);
+    else uring_begin_close(c);
+  });
+}
+
+// Wait no longer than one tick while timers are armed.
+int reactor_wait_ms(const Reactor& r) {
+  return r.timers.size() || r.accept_retry_ms ? static_cast<int>(TIMER_TICK_MS) : 1000;
+}
+
+void epoll_loop(Server& srv, Reactor& r) {
   epoll_event events[MAX_EVENTS];
 
   while (true) {
-    int n = epoll_wait(ep, events, MAX_EVENTS, 1000);
+    int n = epoll_wait(r.ep, events, MAX_EVENTS, reactor_wait_ms(r));
     if (n < 0) {
       if (errno == EINTR) continue;
       throw std::runtime_error("epoll_wait failed");
     }
 
     for (int i = 0; i < n; ++i) {
-      int fd = events[i].data.fd;
+      const ConnId id = events[i].data.u64;
       uint32_t ee = events[i].events;
 
-      if (fd == listen_fd) {
+      if (id == EV_WAKE) {
+        uint64_t v;
+        (void)!::read(r.wake_fd, &v, sizeof(v));
+        on_wake(r);
+        continue;
+      }
+
+      if (id == EV_LISTEN) {
         for (;;) {
           sockaddr_in caddr{};
           socklen_t clen = sizeof(caddr);
-          int cfd = accept(listen_fd, reinterpret_cast<sockaddr*>(&caddr), &clen);
+          int cfd = accept(r.listen_fd, reinterpret_cast<sockaddr*>(&caddr), &clen);
           if (cfd < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) break;
             log_warn("accept error");
             break;
           }
           (void)set_nonblock(cfd);
+          auto [cid, c] = r.conns.emplace();
+          c.fd = cfd;
+          c.id = cid;
           epoll_event cev{};
-          cev.data.fd = cfd;
+          cev.data.u64 = cid;
           cev.events = EPOLLIN;
-          (void)epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &cev);
-          conns.emplace(cfd, Conn{cfd});
+          (void)epoll_ctl(r.ep, EPOLL_CTL_ADD, cfd, &cev);
+          start_conn_timers(srv, r, c);
         }
         continue;
       }
 
-      auto it = conns.find(fd);
-      if (it == conns.end()) continue;
+      Conn* cp = r.conns.get(id);
+      if (!cp) continue;
+      Conn& c = *cp;
 
       if (ee & (EPOLLHUP | EPOLLERR)) {
-        close_conn(fd);
+        close_conn(r, c);
         continue;
       }
 
       // Read
       if (ee & EPOLLIN) {
-        char buf[2048];
+        bool closed = false;
         for (;;) {
-          ssize_t r = ::read(fd, buf, sizeof(buf));
-          if (r == 0) { close_conn(fd); break; }
-          if (r < 0) {
+          ssize_t rd = ::read(c.fd, c.in.prepare(r.bufs, READ_CHUNK), READ_CHUNK);
+          if (rd == 0) { closed = true; break; }
+          if (rd < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            close_conn(fd);
+            closed = true;
             break;
           }
-          it->second.inbuf.append(buf, buf + r);
-
-          // Line-framed JSON requests
-          for (;;) {
-            auto pos = it->second.inbuf.find('\n');
-            if (pos == std::string::npos) break;
-            std::string line = it->second.inbuf.substr(0, pos + 1);
-            it->second.inbuf.erase(0, pos + 1);
-            line = trim_newline(line);
-            if (line.empty()) continue;
-
-            // Backpressure: too many pending transactions
-            {
-              std::lock_guard<std::mutex> lk(pend_mu);
-              if (pending.size() > MAX_PENDING) {
-                it->second.outq.emplace_back("{\"status\":\"BUSY\",\"reason\":\"overload\"}\n");
-                enable_write(fd, true);
-                continue;
-              }
-            }
-
-            const uint64_t corr = next_corr_id();
-            auto pend = std::make_shared<Pending>();
-            {
-              std::lock_guard<std::mutex> lk(pend_mu);
-              pending.emplace(corr, pend);
-            }
-
-            pool.submit([&, fd, corr, pend, req=line] {
-              try {
-                auto msg = pack(MsgType::RouteReq, corr, req);
-
-                // Retry send if MQ is temporarily full
-                bool sent = false;
-                for (int k = 0; k < 1000 && !sent; ++k) {
-                  sent = mq_req.send(msg.data(), msg.size(), 0);
-                  if (!sent) std::this_thread::sleep_for(std::chrono::microseconds(200));
-                }
-                if (!sent) {
-                  std::lock_guard<std::mutex> lk(pend->mu);
-                  pend->resp = "{\"status\":\"ERROR\",\"reason\":\"mq_full\"}";
-                  pend->done = true;
-                  pend->cv.notify_one();
-                }
-
-                // Wait for FLX response (bounded)
-                {
-                  std::unique_lock<std::mutex> lk(pend->mu);
-                  if (!pend->cv.wait_for(lk, std::chrono::milliseconds(500), [&]{ return pend->done; })) {
-                    pend->resp = "{\"status\":\"TIMEOUT\",\"reason\":\"flx_no_response\"}";
-                    pend->done = true;
-                  }
-                }
-
-                // Enqueue response for socket write
-                auto resp_line = pend->resp + "\n";
-                static std::mutex conns_mu; // coarse safety for demo
-                std::lock_guard<std::mutex> lk(conns_mu);
-                auto it2 = conns.find(fd);
-                if (it2 != conns.end()) {
-                  it2->second.outq.emplace_back(std::move(resp_line));
-                  enable_write(fd, true);
-                }
-              } catch (const std::exception& e) {
-                log_err(std::string("worker req error: ") + e.what());
-              }
-            });
-          }
+          c.in.commit(static_cast<size_t>(rd));
+          if (!on_input(srv, r, c)) { closed = true; break; }
         }
+        if (closed) {
+          close_conn(r, c);
+          continue;
+        }
+        c.in.release_if_empty(r.bufs); // no partial frame left: idle again
       }
 
       // Write
-      if (ee & EPOLLOUT) {
-        auto &c = it->second;
-        while (!c.outq.empty()) {
-          const std::string& s = c.outq.front();
-          ssize_t w = ::write(fd, s.data(), s.size());
-          if (w < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            close_conn(fd);
-            break;
-          }
-          if (static_cast<size_t>(w) < s.size()) {
-            // partial write
-            c.outq.front() = s.substr(static_cast<size_t>(w));
-            break;
+      if (ee & EPOLLOUT) (void)epoll_flush(r, c);
+    }
+
+    flush_requests(srv, r);
+    reactor_tick(srv, r);
+
+    // Replies produced on this thread (BUSY, TIMEOUT) go out directly, one
+    // gathered write per connection, without an EPOLLOUT round trip.
+    for (ConnId cid : r.flush) {
+      if (Conn* c = r.conns.get(cid)) (void)epoll_flush(r, *c);
+    }
+    r.flush.clear();
+  }
+}
+
+void init_epoll(Reactor& r) {
+  r.ep = epoll_create1(0);
+  if (r.ep < 0) throw std::runtime_error("epoll_create1 failed");
+
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.u64 = EV_LISTEN;
+  if (epoll_ctl(r.ep, EPOLL_CTL_ADD, r.listen_fd, &ev) != 0) {
+    throw std::runtime_error("epoll_ctl add listen failed");
+  }
+  r.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (r.wake_fd < 0) throw std::runtime_error("eventfd failed");
+  ev.data.u64 = EV_WAKE;
+  if (epoll_ctl(r.ep, EPOLL_CTL_ADD, r.wake_fd, &ev) != 0) {
+    throw std::runtime_error("epoll_ctl add eventfd failed");
+  }
+}
+
+void init_uring(Reactor& r) {
+  r.ring.init(URING_ENTRIES);
+  r.recv_bufs.init(r.ring, URING_RECV_BGID, URING_RECV_BUFS, URING_RECV_BUF_SIZE);
+  r.wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (r.wake_fd < 0) throw std::runtime_error("eventfd failed");
+}
+
+// ---- io_uring backend ----
+// user_data layout: op in the high 32 bits, connection slot index in the low
+// 32 bits (no generation needed: a connection stays in its slot until its
+// last SQE has completed). Zero is reserved for buffer-provide SQEs, which
+// only complete on failure.
+enum UringOp : uint32_t { OP_NONE = 0, OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_WAKE = 4 };
+
+uint64_t uring_ud(UringOp op, uint32_t slot = 0) {
+  return (static_cast<uint64_t>(op) << 32) | slot;
+}
+
+void uring_arm_accept(Reactor& r) {
+  io_uring_sqe* sqe = r.ring.get_sqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = r.listen_fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = uring_ud(OP_ACCEPT);
+}
+
+void uring_arm_recv(Reactor& r, Conn& c) {
+  io_uring_sqe* sqe = r.ring.get_sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = c.fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = r.recv_bufs.group();
+  sqe->user_data = uring_ud(OP_RECV, ConnTable::index(c.id));
+  ++c.inflight;
+}
+
+void uring_arm_wake(Reactor& r) {
+  io_uring_sqe* sqe = r.ring.get_sqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = r.wake_fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&r.wake_val);
+  sqe->len = sizeof(r.wake_val);
+  sqe->user_data = uring_ud(OP_WAKE);
+}
+
+void uring_submit_send(Reactor& r, Conn& c) {
+  io_uring_sqe* sqe = r.ring.get_sqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = c.fd;
+  sqe->addr = reinterpret_cast<uint64_t>(c.sendbuf.data());
+  sqe->len = static_cast<uint32_t>(c.sendbuf.size());
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = uring_ud(OP_SEND, ConnTable::index(c.id));
+  c.sending = true;
+  ++c.inflight;
+}
+
+// Send everything queued for c. The output block itself becomes the pinned
+// send buffer (a swap, no copy); later responses start a fresh block.
+void uring_start_send(Reactor& r, Conn& c) {
+  if (c.sending || c.closing || c.out.empty()) return;
+  c.sendbuf.release(r.bufs);
+  c.sendbuf.swap(c.out);
+  uring_submit_send(r, c);
+}
+
+// shutdown() makes the kernel complete the outstanding multishot recv and any
+// send; the fd itself is closed once nothing in the ring references it, so it
+// cannot be reused underneath a late completion.
+void uring_begin_close(Conn& c) {
+  if (c.closing) return;
+  c.closing = true;
+  (void)::shutdown(c.fd, SHUT_RDWR);
+}
+
+void uring_maybe_reap(Reactor& r, Conn& c) {
+  if (!c.closing || c.inflight > 0) return;
+  ::close(c.fd);
+  destroy_conn(r, c);
+}
+
+void uring_loop(Server& srv, Reactor& r) {
+  uring_arm_accept(r);
+  uring_arm_wake(r);
+
+  while (true) {
+    // One syscall per iteration: submit everything queued, reap completions.
+    r.ring.submit_and_wait(1, reactor_wait_ms(r));
+
+    r.ring.drain([&](const io_uring_cqe& cqe) {
+      const auto op = static_cast<UringOp>(cqe.user_data >> 32);
+      const auto slot = static_cast<uint32_t>(cqe.user_data);
+      const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+      if (op == OP_NONE) {
+        if (cqe.res < 0) log_warn("recv buffer re-provide failed: " + std::string(std::strerror(-cqe.res)));
+        return;
+      }
+
+      if (op == OP_ACCEPT) {
+        if (cqe.res >= 0) {
+          auto [cid, c] = r.conns.emplace();
+          c.fd = cqe.res;
+          c.id = cid;
+          start_conn_timers(srv, r, c);
+          uring_arm_recv(r, c);
+          if (!more) uring_arm_accept(r);
+        } else if (cqe.res == -EAGAIN) {
+          if (!more) uring_arm_accept(r);
+        } else {
+          // EMFILE and friends fail again straight away: retry from the
+          // next tick instead of spinning on the ring.
+          log_warn("accept error: " + std::string(std::strerror(-cqe.res)));
+          if (!more) r.accept_retry_ms = steady_millis() + TIMER_TICK_MS;
+        }
+        return;
+      }
+
+      if (op == OP_WAKE) {
+        on_wake(r);
+        uring_arm_wake(r);
+        return;
+      }
+
+      Conn* cp = r.conns.at(slot);
+      if (!cp) return;
+      Conn& c = *cp;
+
+      if (op == OP_RECV) {
+        if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+          const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+          if (!c.closing && !on_input(srv, r, c, r.recv_bufs.buf(bid), static_cast<size_t>(cqe.res))) {
+            uring_begin_close(c); // corrupt binary framing
           }
-          c.outq.pop_front();
+          r.recv_bufs.recycle(bid);
+        } else if (cqe.res == 0 || cqe.res != -ENOBUFS) {
+          uring_begin_close(c); // EOF or hard error
         }
-        if (conns.find(fd) != conns.end()) {
-          if (c.outq.empty()) enable_write(fd, false);
+        if (!more) {
+          --c.inflight;
+          // Multishot stops on ENOBUFS or when the CQ overflows; re-arm.
+          if (!c.closing) uring_arm_recv(r, c);
         }
+      } else if (op == OP_SEND) {
+        --c.inflight;
+        c.sending = false;
+        if (cqe.res < 0) {
+          uring_begin_close(c);
+        } else {
+          c.last_active_ms = steady_millis();
+          c.sendbuf.consume(static_cast<size_t>(cqe.res));
+          if (!c.sendbuf.empty() && !c.closing) {
+            uring_submit_send(r, c);
+          } else {
+            c.sendbuf.release(r.bufs);
+            uring_start_send(r, c);
+          }
+        }
+      }
+      uring_maybe_reap(r, c);
+    });
+
+    flush_requests(srv, r);
+    reactor_tick(srv, r);
+    if (r.accept_retry_ms && steady_millis() >= r.accept_retry_ms) {
+      r.accept_retry_ms = 0;
+      uring_arm_accept(r);
+    }
+
+    // Start sends for every connection that got output this iteration; they
+    // are submitted together with the next wait.
+    for (ConnId cid : r.flush) {
+      if (Conn* c = r.conns.get(cid)) uring_start_send(r, *c);
+    }
+    r.flush.clear();
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Server srv;
+  ServerOptions& opt = srv.opt;
+  opt = parse_options(argc, argv);
+#ifndef SO_REUSEPORT
+  if (opt.reactors > 1) {
+    log_warn("SO_REUSEPORT unavailable; falling back to a single reactor");
+    opt.reactors = 1;
+  }
+#endif
+
+  // One fd per client: lift the soft limit to the hard one.
+  rlimit nofile{};
+  if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max) {
+    nofile.rlim_cur = nofile.rlim_max;
+    (void)setrlimit(RLIMIT_NOFILE, &nofile);
+  }
+
+  // Server expects queues already created (each engine shard creates its own).
+  opt.batch_bytes = std::min(opt.batch_bytes, static_cast<size_t>(FLX_MSG_SIZE));
+  {
+    std::vector<std::shared_ptr<Shard>> shards;
+    for (uint32_t i = 0; i < opt.shards; ++i) shards.push_back(open_shard(srv, i));
+    std::lock_guard<std::mutex> lk(srv.shard_mu);
+    publish_shards(srv, std::move(shards));
+  }
+
+  log_info("Routing server starting on " + opt.host + ":" + std::to_string(opt.port) +
+           " reactors=" + std::to_string(opt.reactors) + " transport=" + transport_name(opt.transport) +
+           " batch_bytes=" + std::to_string(opt.batch_bytes) + " shards=" + std::to_string(opt.shards) +
+           " max_fds=" + std::to_string(nofile.rlim_cur));
+
+  if (opt.admin_port) {
+    const int fd = open_listener("127.0.0.1", opt.admin_port, false);
+    log_info("Shard admin listening on 127.0.0.1:" + std::to_string(opt.admin_port));
+    std::thread([&srv, fd] { admin_loop(srv, fd); }).detach(); // lives as long as the process
+  }
+
+  // Each reactor binds its own listen socket; the kernel spreads incoming
+  // connections across them via SO_REUSEPORT.
+  std::vector<std::unique_ptr<Reactor>> reactors;
+  for (size_t i = 0; i < opt.reactors; ++i) {
+    auto r = std::make_unique<Reactor>();
+    r->id = static_cast<int>(i);
+    adopt_shards(srv, *r);
+    r->listen_fd = open_listener(opt.host, opt.port);
+
+    if (opt.backend == IoBackend::Uring) {
+      try {
+        init_uring(*r);
+      } catch (const std::exception& e) {
+        if (i != 0) throw; // kernel support does not change between reactors
+        // Keep serving: epoll is always available.
+        log_warn(std::string("io_uring unavailable, falling back to epoll: ") + e.what());
+        opt.backend = IoBackend::Epoll;
       }
     }
+    if (opt.backend == IoBackend::Epoll) init_epoll(*r);
+    r->backend = opt.backend;
+    reactors.push_back(std::move(r));
+  }
+
+  log_info(std::string("I/O backend: ") + (opt.backend == IoBackend::Uring ? "io_uring" : "epoll"));
+
+  // Worker pool for request forwarding (MQ send)
+  const size_t nworkers = std::max<size_t>(2, std::thread::hardware_concurrency());
+  srv.pool = std::make_unique<ThreadPool>(nworkers);
+
+  for (auto& r : reactors) {
+    Reactor* rp = r.get();
+    rp->th = std::thread([&srv, rp] {
+      try {
+        if (rp->backend == IoBackend::Uring) uring_loop(srv, *rp);
+        else epoll_loop(srv, *rp);
+      }
+      catch (const std::exception& e) {
+        log_err("reactor " + std::to_string(rp->id) + " stopped: " + e.what());
+      }
+    });
   }
+  for (auto& r : reactors) r->th.join();
 
-  run = false;
-  resp_thread.join();
+  std::lock_guard<std::mutex> lk(srv.shard_mu);
+  for (auto& sh : srv.shards->shards) sh->run = false;
+  for (auto& sh : srv.shards->shards) sh->dispatcher.join();
+  for (auto& sh : srv.retired) sh->dispatcher.join();
   return 0;
 }